@@ -0,0 +1,376 @@
+/* Minesweeper solver benchmark.
+   Generates seeded grids in process, as ms_gen.pl does, and times the
+   solver on them across a matrix of flags and thread counts. The solver is
+   compiled in, with its main () renamed, so runs pay no process start up,
+   file or output costs. Reports the median and 99th percentile time, nodes
+   per second and thread scaling efficiency of each case as CSV or JSON, and
+   can compare them against a baseline from an earlier run. Comparisons go
+   by the sum of each grid's fastest run, which is much steadier than the
+   median when runs take well under a millisecond.
+*/
+
+#define main ms_solve_main
+#include "ms_solve.c"
+#undef main
+
+/*****************************************************************************
+ *
+ *  Structures
+ *
+ ****************************************************************************/
+
+/* Set of solver flags. */
+struct flags
+{
+  const char *name;           // Flags as given to ms_solve.
+  bool single;                // Stop at the first solution.
+  bool force;
+  bool preresolve;
+  bool target;                // Set the mine target to the mines placed.
+};
+
+/* Corpus of grids of one size. */
+struct corpus
+{
+  int side;                   // Rows and columns.
+  double mine_pct;            // Fraction of tiles that are mines.
+  double blank_pct;           // Fraction of tiles that are unknown.
+};
+
+/* Results of one case. */
+struct result
+{
+  const struct flags *flags;
+  int threads;
+  const struct corpus *corpus;
+  double median;              // ms.
+  double p99;                 // ms.
+  double best;                // Sum of each grid's fastest run, in ms.
+  double nodes_per_s;
+  double efficiency;          // Speed up over 1 thread, per thread.
+};
+
+/*****************************************************************************
+ *
+ *  Globals
+ *
+ ****************************************************************************/
+
+static const struct flags flag_sets[] = {
+  {"-a", false, false, false, false},
+  {"-a -r", false, false, true, false},
+  {"-a -f", false, true, false, false},
+  {"-a -r -f", false, true, true, false},
+  {"-m", true, false, false, true},
+};
+#define NFLAG_SETS (int) (sizeof flag_sets / sizeof flag_sets[0])
+
+static const struct corpus corpora[] = {
+  {10, 0.2, 0.6},
+  {12, 0.2, 0.5},
+  {16, 0.2, 0.4},
+};
+#define NCORPORA (int) (sizeof corpora / sizeof corpora[0])
+
+/* Argument settings. */
+static uint64_t bench_seed = 1;  // Seed of the first grid.
+static int bench_grids = 20;     // Grids per corpus.
+static int bench_repeats = 5;    // Runs per grid.
+static int bench_threads = 4;    // Most threads; cases double up to it.
+static bool bench_json = false;  // Print JSON instead of CSV.
+static char *bench_out = NULL;   // Also write CSV here.
+static char *bench_base = NULL;  // Compare against this CSV.
+static double bench_tol = 10;    // Regression tolerance, in percent.
+
+/*****************************************************************************
+ *
+ *  Benchmark functions.
+ *
+ ****************************************************************************/
+
+/* Generate grid number N of CORPUS, and its number of mines in MINES. */
+static char * grid_gen (const struct corpus *corpus, int n, int *mines)
+{
+  int side = corpus->side;
+  int ntiles = side * side;
+
+  // Seed each grid on its own, so grids don't depend on the others.
+  rng_state = (bench_seed + n) * 0x9e3779b97f4a7c15ULL + side;
+  if (!rng_state)
+    rng_state = 1;
+
+  *mines = (int) (ntiles * corpus->mine_pct);
+  return grid_random (side, side, *mines, (int) (ntiles * corpus->blank_pct));
+}
+
+/* Solve GRID, holding MINES mines, once with FLAGS on THREADS threads.
+   Returns the time taken by preprocessing and search, in ms, and adds the
+   nodes searched to NODES. */
+static double bench_run (const struct flags *flags, int threads, char *grid,
+                         int mines, long long *nodes)
+{
+  single = flags->single;
+  force = flags->force;
+  preresolve = flags->preresolve;
+  mine_target = flags->target ? mines : -1;
+  max_threads = avail_threads = threads;
+  goal_states = 0;
+
+  thread_alloc ();
+  FILE *fh = fmemopen (grid, strlen (grid), "r");
+  parse_stream (fh);
+  fclose (fh);
+
+  double start = now_ms ();
+  preprocess_grid ();
+  if (total_unknowns > 0)
+    search ();
+  double time = now_ms () - start;
+
+  int i;
+  for (i = 0; i < threads; i++)
+    *nodes += thr_stats[i].nodes;
+  thread_free ();
+  return time;
+}
+
+static int comp_doubles (const void *arg1, const void *arg2)
+{
+  double a = *(const double *) arg1;
+  double b = *(const double *) arg2;
+  return a < b ? -1 : a > b;
+}
+
+/* Run every grid of CORPUS with FLAGS on THREADS threads into RES. */
+static void bench_case (const struct flags *flags, int threads,
+                        const struct corpus *corpus, struct result *res)
+{
+  int nruns = bench_grids * bench_repeats;
+  double *times = (double *) malloc (nruns * sizeof (double));
+  long long nodes = 0;
+  double total = 0;
+  double best = 0;
+  int g, r, n = 0;
+
+  for (g = 0; g < bench_grids; g++)
+    {
+      int mines;
+      char *grid = grid_gen (corpus, g, &mines);
+      double fastest = 0;
+      for (r = 0; r < bench_repeats; r++)
+        {
+          times[n] = bench_run (flags, threads, grid, mines, &nodes);
+          if (!r || times[n] < fastest)
+            fastest = times[n];
+          total += times[n++];
+        }
+      best += fastest;
+      free (grid);
+    }
+
+  // Nearest rank percentiles.
+  qsort (times, nruns, sizeof (double), comp_doubles);
+  res->flags = flags;
+  res->threads = threads;
+  res->corpus = corpus;
+  res->median = times[(nruns - 1) / 2];
+  res->p99 = times[(int) ceil (0.99 * nruns) - 1];
+  res->best = best;
+  res->nodes_per_s = total > 0 ? nodes / (total / 1000) : 0;
+  res->efficiency = 1;
+
+  free (times);
+}
+
+/* Print RES as CSV to FH. */
+static void result_csv (FILE *fh, struct result *res, int nres)
+{
+  int i;
+  fprintf (fh, "flags,threads,side,grids,runs,median_ms,p99_ms,"
+           "best_ms,nodes_per_s,efficiency\n");
+  for (i = 0; i < nres; i++)
+    fprintf (fh, "%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.0f,%.3f\n",
+             res[i].flags->name, res[i].threads, res[i].corpus->side,
+             bench_grids, bench_grids * bench_repeats, res[i].median,
+             res[i].p99, res[i].best, res[i].nodes_per_s,
+             res[i].efficiency);
+}
+
+/* Print RES as JSON. */
+static void result_json (struct result *res, int nres)
+{
+  int i;
+  printf ("[\n");
+  for (i = 0; i < nres; i++)
+    printf ("  {\"flags\": \"%s\", \"threads\": %d, \"side\": %d, "
+            "\"grids\": %d, \"runs\": %d, \"median_ms\": %.4f, "
+            "\"p99_ms\": %.4f, \"best_ms\": %.4f, "
+            "\"nodes_per_s\": %.0f, \"efficiency\": %.3f}%s\n",
+            res[i].flags->name, res[i].threads, res[i].corpus->side,
+            bench_grids, bench_grids * bench_repeats, res[i].median,
+            res[i].p99, res[i].best, res[i].nodes_per_s, res[i].efficiency,
+            i < nres - 1 ? "," : "");
+  printf ("]\n");
+}
+
+/* Compare RES against the CSV in BENCH_BASE. Returns the number of cases
+   slower by more than BENCH_TOL percent. */
+static int result_compare (struct result *res, int nres)
+{
+  FILE *fh = fopen (bench_base, "r");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", bench_base);
+      exit (1);
+    }
+
+  char line[INBUF_SIZ];
+  int regressions = 0;
+  int matched = 0;
+  fgets (line, INBUF_SIZ, fh);
+  while (fgets (line, INBUF_SIZ, fh))
+    {
+      char name[64];
+      int threads, side, grids;
+      double best;
+      if (sscanf (line, "%63[^,],%d,%d,%d,%*d,%*f,%*f,%lf", name, &threads,
+                  &side, &grids, &best) != 5)
+        continue;
+
+      // Sums of different numbers of grids don't compare.
+      int i;
+      for (i = 0; i < nres; i++)
+        if (!strcmp (res[i].flags->name, name) && res[i].threads == threads
+            && res[i].corpus->side == side && grids == bench_grids)
+          break;
+      if (i == nres)
+        continue;
+
+      // Times too short to measure apart are never regressions.
+      matched++;
+      double change = best > 0 ? 100 * (res[i].best - best) / best : 0;
+      if (change > bench_tol && res[i].best - best > 0.05)
+        {
+          fprintf (stderr, "Regression: %s, %d threads, side %d: "
+                   "%.4f ms, was %.4f ms (%+.1f%%)\n", name, threads, side,
+                   res[i].best, best, change);
+          regressions++;
+        }
+    }
+  fclose (fh);
+
+  fprintf (stderr, "%d of %d cases compared, %d regressions.\n", matched,
+           nres, regressions);
+  return regressions;
+}
+
+__attribute__ ((noreturn))
+static void bench_help ()
+{
+  printf ("\
+Minesweeper solver benchmark.\n\
+Usage:\n\
+  ms_bench [OPTION]...\n\n\
+Options:\n\
+  -b BASELINE       Compare times against BASELINE, a CSV written by -o, and\n\
+                    exit with 1 if any case is slower by more than the\n\
+                    tolerance.\n\
+  -h                Print this help message.\n\
+  -j                Print JSON instead of CSV.\n\
+  -n GRIDS          Grids per size. Default 20.\n\
+  -o FILE           Also write the results to FILE as CSV.\n\
+  -r REPEATS        Runs per grid. Default 5.\n\
+  -s SEED           Seed of the grids. Default 1.\n\
+  -t THREADS        Most threads to run with. Thread counts double from 1\n\
+                    up to THREADS. Default 4.\n\
+  -x TOLERANCE      Percent slower than the baseline that counts as a\n\
+                    regression. Default 10.\n\n");
+  exit (0);
+}
+
+int main (int argc, char **argv)
+{
+  int c;
+  while ((c = getopt (argc, argv, "b:hjn:o:r:s:t:x:")) != -1)
+    {
+      switch (c)
+        {
+        case 'b':
+          bench_base = optarg;
+          break;
+        case 'h':
+          bench_help ();
+        case 'j':
+          bench_json = true;
+          break;
+        case 'n':
+          bench_grids = atoi (optarg);
+          break;
+        case 'o':
+          bench_out = optarg;
+          break;
+        case 'r':
+          bench_repeats = atoi (optarg);
+          break;
+        case 's':
+          bench_seed = strtoull (optarg, NULL, 10);
+          break;
+        case 't':
+          bench_threads = atoi (optarg);
+          break;
+        case 'x':
+          bench_tol = atof (optarg);
+          break;
+        default:
+          exit (1);
+        }
+    }
+  if (bench_grids < 1 || bench_repeats < 1 || bench_threads < 1)
+    {
+      fprintf (stderr, "Invalid arguments.\n");
+      exit (1);
+    }
+  print = PRINT_NONE;
+
+  int nthread_counts = 0;
+  int t;
+  for (t = 1; t <= bench_threads; t *= 2)
+    nthread_counts++;
+  struct result *res = (struct result *)
+    malloc (NFLAG_SETS * nthread_counts * NCORPORA * sizeof *res);
+  int nres = 0;
+  int f, k;
+
+  for (f = 0; f < NFLAG_SETS; f++)
+    for (k = 0; k < NCORPORA; k++)
+      {
+        int one = nres;
+        for (t = 1; t <= bench_threads; t *= 2)
+          {
+            bench_case (&flag_sets[f], t, &corpora[k], &res[nres]);
+            if (t > 1 && res[nres].median > 0)
+              res[nres].efficiency = res[one].median / (res[nres].median * t);
+            nres++;
+          }
+      }
+
+  if (bench_json)
+    result_json (res, nres);
+  else
+    result_csv (stdout, res, nres);
+  if (bench_out)
+    {
+      FILE *fh = fopen (bench_out, "w");
+      if (!fh)
+        {
+          fprintf (stderr, "Could not open %s.\n", bench_out);
+          exit (1);
+        }
+      result_csv (fh, res, nres);
+      fclose (fh);
+    }
+
+  int regressions = bench_base ? result_compare (res, nres) : 0;
+  free (res);
+  return regressions ? 1 : 0;
+}
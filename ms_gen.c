@@ -0,0 +1,545 @@
+/* Minesweeper grid generator.
+   Deals seeded random boards, as ms_gen.pl does, and keeps the ones whose
+   structure meets the filters given: the number of frontier components, the
+   size of the search tree and the number of solutions, all measured with the
+   solver's own constraint system and decision diagrams. The solver is
+   compiled in, with its main () renamed.
+
+   Boards are written as they are made, in the solver's input format or as a
+   binary grid stream, for ms_solve -b to read. With several jobs, boards
+   are made by forked workers, since the solver keeps its state in globals,
+   and written in order, so the output only depends on the seed.
+*/
+
+#define main ms_solve_main
+#include "ms_solve.c"
+#undef main
+
+#include <sys/wait.h>
+
+/*****************************************************************************
+ *
+ *  Structures
+ *
+ ****************************************************************************/
+
+/* Range a measure of a board must fall in. */
+struct range
+{
+  bool set;                   // Filter on this measure.
+  double lo;
+  double hi;
+};
+
+/* Measures of a board. */
+struct measures
+{
+  int comps;                  // Frontier components.
+  long double tree;           // Nodes of the search tree.
+  long double solutions;
+};
+
+/*****************************************************************************
+ *
+ *  Globals
+ *
+ ****************************************************************************/
+
+/* Argument settings. */
+static int gen_rows;
+static int gen_cols;
+static double blank_pct = 50;    // Percent of tiles turned to unknowns.
+static double mine_pct = 20;     // Percent of tiles that are mines.
+static int gen_mines = -1;       // Mines, instead of MINE_PCT.
+static long gen_grids = 1;       // Boards to write, 0 for no end.
+static uint64_t gen_seed = 0;    // Seed of the first board.
+static int gen_jobs = 1;         // Worker processes.
+static int gen_tries = 100000;   // Boards dealt per board kept, at most.
+static bool gen_binary = false;  // Write a binary grid stream.
+static bool gen_known = false;   // Count with the number of mines known.
+static bool gen_resolve = false; // Pre-resolve before measuring.
+static bool verbose = false;     // Print each board's measures.
+static struct range comps_range;
+static struct range tree_range;
+static struct range sol_range;
+
+/*****************************************************************************
+ *
+ *  Generator functions.
+ *
+ ****************************************************************************/
+
+/* Parse RANGE from ARG: N for exactly N, N: for at least N, :N for at most
+   N, or N:M. */
+static void range_parse (char *arg, struct range *range)
+{
+  char *end;
+  range->set = true;
+  range->lo = 0;
+  range->hi = HUGE_VAL;
+  if (*arg != ':')
+    range->lo = range->hi = strtod (arg, &end);
+  else
+    end = arg;
+  if (*end == ':')
+    {
+      range->hi = HUGE_VAL;
+      if (end[1])
+        range->hi = strtod (end + 1, &end);
+      else
+        end++;
+    }
+  if (*end || range->lo > range->hi)
+    {
+      fprintf (stderr, "Invalid range: %s\n", arg);
+      exit (1);
+    }
+}
+
+static inline bool in_range (struct range *range, long double val)
+{
+  return !range->set || (val >= range->lo && val <= range->hi);
+}
+
+/* Find the nodes of the search tree and the solutions of DD, built over
+   every unknown in search order. The nodes are the partial assignments, in
+   search order, that can still be completed to a solution: the tree of a
+   search that prunes perfectly, which the solver's search can only match or
+   exceed. Each is a path from the root to a node that leads to the
+   terminal. */
+static void dd_tree (struct dd *dd, struct measures *m)
+{
+  int n = dd->nlevels;
+  int term = dd->level_start[n+1] - 1;
+  bool *alive = (bool *) malloc (dd->nnodes + 1);
+  long double *paths = (long double *) calloc (dd->nnodes + 1,
+                                               sizeof (long double));
+  int u, x;
+
+  m->tree = m->solutions = 0;
+  if (dd->level_start[n] > term)
+    {
+      free (alive);
+      free (paths);
+      return;
+    }
+
+  // Children are made after their parents, so come later.
+  for (u = dd->nnodes - 1; u >= 0; u--)
+    {
+      alive[u] = u == term;
+      for (x = 0; x < 2 && u != term; x++)
+        if (dd->child[u][x] >= 0 && alive[dd->child[u][x]])
+          alive[u] = true;
+    }
+  paths[0] = alive[0];
+  for (u = 0; u < dd->nnodes; u++)
+    {
+      if (!alive[u])
+        continue;
+      m->tree += paths[u];
+      for (x = 0; x < 2 && u != term; x++)
+        if (dd->child[u][x] >= 0 && alive[dd->child[u][x]])
+          paths[dd->child[u][x]] += paths[u];
+    }
+  m->solutions = paths[term];
+
+  free (alive);
+  free (paths);
+}
+
+/* Measure BOARD, which holds MINES mines, into M. The search tree and
+   solutions are only counted if COUNT. Returns false if they are too many
+   to lay out in a decision diagram. */
+static bool measure (char *board, int mines, bool count, struct measures *m)
+{
+  single = false;
+  preresolve = gen_resolve;
+  mine_target = gen_known ? mines : -1;
+  max_threads = avail_threads = 1;
+  goal_states = 0;
+
+  thread_alloc ();
+  FILE *fh = fmemopen (board, strlen (board), "r");
+  parse_stream (fh);
+  fclose (fh);
+  preprocess_grid ();
+
+  struct csp *csp = csp_build (thr_data[0].bufs.grid, thr_data[0].bufs.ind,
+                               total_unknowns);
+  int n = csp->nvars;
+  bool ok = true;
+  m->comps = csp->ncomps;
+  m->tree = m->solutions = 0;
+
+  // As in zdd_solutions (), a target past the unknowns left can't be met.
+  if (count && !csp->unsat && mine_target >= -1 && mine_target <= n)
+    {
+      int *order = (int *) malloc ((n + 1) * sizeof (int));
+      int *level = (int *) malloc ((n + 1) * sizeof (int));
+      int i;
+      for (i = 0; i < n; i++)
+        order[i] = i;
+      struct dd *dd = dd_build (csp, order, n, level, false, mine_target);
+      if (dd)
+        {
+          dd_tree (dd, m);
+          dd_free (dd);
+        }
+      else
+        ok = false;
+      free (order);
+      free (level);
+    }
+
+  csp_free (csp);
+  thread_free ();
+  return ok;
+}
+
+/* Write BOARD to BUF as a binary grid record. Returns its length. */
+static int board_pack (char *board, unsigned char *buf)
+{
+  int dims[2] = {gen_rows, gen_cols};
+  memcpy (buf, dims, sizeof dims);
+  unsigned char *packed = buf + sizeof dims;
+  int ntiles = gen_rows * gen_cols;
+  memset (packed, 0, (ntiles + 1) / 2);
+
+  // Skip the dimensions line.
+  char *p = strchr (board, '\n') + 1;
+  int t = 0;
+  for (; *p; p++)
+    {
+      if (*p == '\n')
+        continue;
+      int code = strchr (GRIDS_TILES, *p) - GRIDS_TILES;
+      packed[t / 2] |= code << (t % 2 * 4);
+      t++;
+    }
+  return sizeof dims + (ntiles + 1) / 2;
+}
+
+/* Make board number K: deal boards from K's seed until one passes the
+   filters. Returns its record, text or binary, and its length in LEN, or
+   NULL if no board passed in GEN_TRIES. */
+static unsigned char * board_make (long k, int *len)
+{
+  int ntiles = gen_rows * gen_cols;
+  int mines = gen_mines >= 0 ? gen_mines : (int) (ntiles * mine_pct / 100);
+  int blanks = (int) (ntiles * blank_pct / 100);
+  bool filter = comps_range.set || tree_range.set || sol_range.set;
+  bool count = tree_range.set || sol_range.set || verbose;
+  int t;
+
+  rng_state = (gen_seed + k) * 0x9e3779b97f4a7c15ULL + 1;
+  if (!rng_state)
+    rng_state = 1;
+
+  for (t = 0; t < gen_tries; t++)
+    {
+      char *board = grid_random (gen_rows, gen_cols, mines, blanks);
+      struct measures m;
+      bool counted = (filter || verbose) && measure (board, mines, count, &m);
+      if (filter && !(counted && in_range (&comps_range, m.comps)
+                      && in_range (&tree_range, m.tree)
+                      && in_range (&sol_range, m.solutions)))
+        {
+          free (board);
+          continue;
+        }
+
+      if (verbose && counted)
+        fprintf (stderr, "Board %ld: %d components, %.0Lf tree nodes, "
+                 "%.0Lf solutions, %d tries\n", k, m.comps, m.tree,
+                 m.solutions, t + 1);
+      else if (verbose)
+        fprintf (stderr, "Board %ld: too many solutions to count, "
+                 "%d tries\n", k, t + 1);
+      unsigned char *rec = (unsigned char *) malloc (strlen (board) + 32);
+      if (gen_binary)
+        *len = board_pack (board, rec);
+      else
+        *len = sprintf ((char *) rec, "%s\n", board);
+      free (board);
+      return rec;
+    }
+  return NULL;
+}
+
+/* Write LEN bytes of BUF to FD, or exit. */
+static void write_all (int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *) buf;
+  while (len > 0)
+    {
+      ssize_t n = write (fd, p, len);
+      if (n <= 0)
+        _exit (1);
+      p += n;
+      len -= n;
+    }
+}
+
+/* Read LEN bytes of FD into BUF. Returns false if FD ends first. */
+static bool read_all (int fd, void *buf, size_t len)
+{
+  char *p = (char *) buf;
+  while (len > 0)
+    {
+      ssize_t n = read (fd, p, len);
+      if (n <= 0)
+        return false;
+      p += n;
+      len -= n;
+    }
+  return true;
+}
+
+static void no_board (long k)
+{
+  fprintf (stderr, "No board %ld passed the filters in %d tries.\n", k,
+           gen_tries);
+  exit (1);
+}
+
+/* Make boards in GEN_JOBS worker processes. Worker W makes boards W,
+   W + GEN_JOBS, and so on, and sends each down its pipe as its length and
+   then its record, or a length of -1 if it gave up. Boards are read back in
+   order, so a worker that's ahead waits on its pipe. */
+static void gen_parallel ()
+{
+  int (*fds)[2] = (int (*)[2]) malloc (gen_jobs * sizeof *fds);
+  pid_t *pids = (pid_t *) malloc (gen_jobs * sizeof (pid_t));
+  int w, i;
+
+  fflush (stdout);
+  for (w = 0; w < gen_jobs; w++)
+    {
+      if (pipe (fds[w]))
+        {
+          fprintf (stderr, "Could not create pipe.\n");
+          exit (1);
+        }
+      pids[w] = fork ();
+      if (pids[w] < 0)
+        {
+          fprintf (stderr, "Could not fork.\n");
+          exit (1);
+        }
+      if (!pids[w])
+        {
+          for (i = 0; i <= w; i++)
+            close (fds[i][0]);
+          long k;
+          for (k = w; !gen_grids || k < gen_grids; k += gen_jobs)
+            {
+              int len;
+              unsigned char *rec = board_make (k, &len);
+              if (!rec)
+                {
+                  len = -1;
+                  write_all (fds[w][1], &len, sizeof len);
+                  _exit (1);
+                }
+              write_all (fds[w][1], &len, sizeof len);
+              write_all (fds[w][1], rec, len);
+              free (rec);
+            }
+          _exit (0);
+        }
+      close (fds[w][1]);
+    }
+
+  long k;
+  unsigned char *rec = NULL;
+  int cap = 0;
+  for (k = 0; !gen_grids || k < gen_grids; k++)
+    {
+      int fd = fds[k % gen_jobs][0];
+      int len;
+      if (!read_all (fd, &len, sizeof len))
+        {
+          fprintf (stderr, "Worker for board %ld failed.\n", k);
+          exit (1);
+        }
+      if (len < 0)
+        no_board (k);
+      if (len > cap)
+        {
+          cap = len;
+          rec = (unsigned char *) realloc (rec, cap);
+        }
+      if (!read_all (fd, rec, len))
+        {
+          fprintf (stderr, "Worker for board %ld failed.\n", k);
+          exit (1);
+        }
+      fwrite (rec, 1, len, stdout);
+    }
+  fflush (stdout);
+
+  for (w = 0; w < gen_jobs; w++)
+    {
+      close (fds[w][0]);
+      waitpid (pids[w], NULL, 0);
+    }
+  free (rec);
+  free (fds);
+  free (pids);
+}
+
+__attribute__ ((noreturn))
+static void gen_help ()
+{
+  printf ("\
+Minesweeper grid generator.\n\
+Usage:\n\
+  ms_gen [OPTION]... ROWS COLS\n\n\
+Options:\n\
+  -b BLANK_PCT      Percent of tiles turned to unknowns. Default 50.\n\
+  -B                Write a binary grid stream: \"MSGRIDS1\\n\", then for each\n\
+                    board its rows and columns (ints) and its tiles, two to\n\
+                    a byte, low 4 bits first, each an index into\n\
+                    \"012345678?*-\".\n\
+  -C RANGE          Keep boards with RANGE frontier components.\n\
+  -d MINE_PCT       Percent of tiles that are mines. Default 20.\n\
+  -E RANGE          Keep boards whose search tree has RANGE nodes. Nodes are\n\
+                    the partial assignments, in search order, that can still\n\
+                    be completed to a solution, which the solver visits at\n\
+                    the least.\n\
+  -h                Print this help message.\n\
+  -j JOBS           Worker processes to make boards with. Default 1.\n\
+  -k                Count solutions with the number of mines known, as\n\
+                    ms_solve -m does.\n\
+  -m MINES          Number of mines, instead of -d.\n\
+  -n GRIDS          Boards to write, 0 for no end. Default 1.\n\
+  -r                Pre-resolve unknowns before measuring, as ms_solve -r\n\
+                    does.\n\
+  -s SEED           Seed of the first board. Default from the clock.\n\
+  -S RANGE          Keep boards with RANGE solutions.\n\
+  -t TRIES          Most boards to deal for each one kept. Default 100000.\n\
+  -u                Keep boards with a unique solution, as -S 1.\n\
+  -v                Print the measures of each board kept to standard\n\
+                    error.\n\n\
+A RANGE is N for exactly N, N: for at least N, :N for at most N, or N:M.\n\
+Boards whose solutions are too many to count never pass -E or -S.\n\n");
+  exit (0);
+}
+
+int main (int argc, char **argv)
+{
+  int c;
+  while ((c = getopt (argc, argv, "b:BC:d:E:hj:km:n:rs:S:t:uv")) != -1)
+    {
+      switch (c)
+        {
+        case 'b':
+          blank_pct = atof (optarg);
+          break;
+        case 'B':
+          gen_binary = true;
+          break;
+        case 'C':
+          range_parse (optarg, &comps_range);
+          break;
+        case 'd':
+          mine_pct = atof (optarg);
+          break;
+        case 'E':
+          range_parse (optarg, &tree_range);
+          break;
+        case 'h':
+          gen_help ();
+        case 'j':
+          gen_jobs = atoi (optarg);
+          break;
+        case 'k':
+          gen_known = true;
+          break;
+        case 'm':
+          gen_mines = atoi (optarg);
+          break;
+        case 'n':
+          gen_grids = atol (optarg);
+          break;
+        case 'r':
+          gen_resolve = true;
+          break;
+        case 's':
+          gen_seed = strtoull (optarg, NULL, 10);
+          break;
+        case 'S':
+          range_parse (optarg, &sol_range);
+          break;
+        case 't':
+          gen_tries = atoi (optarg);
+          break;
+        case 'u':
+          range_parse ("1", &sol_range);
+          break;
+        case 'v':
+          verbose = true;
+          break;
+        default:
+          exit (1);
+        }
+    }
+
+  if (argc - optind < 2)
+    {
+      fprintf (stderr, "Not enough arguments.\n");
+      exit (1);
+    }
+  gen_rows = atoi (argv[optind]);
+  gen_cols = atoi (argv[optind+1]);
+  int ntiles = gen_rows * gen_cols;
+  if (gen_rows < 1 || gen_cols < 1 || gen_cols >= INBUF_SIZ - 2)
+    {
+      fprintf (stderr, "Invalid grid dimensions.\n");
+      exit (1);
+    }
+  if (gen_mines > ntiles || mine_pct < 0 || mine_pct > 100)
+    {
+      fprintf (stderr, "Too many mines for grid dimensions.\n");
+      exit (1);
+    }
+  if (blank_pct < 0 || blank_pct > 100)
+    {
+      fprintf (stderr, "Invalid blank percentage: %g%%\n", blank_pct);
+      exit (1);
+    }
+  if (gen_jobs < 1 || gen_tries < 1 || gen_grids < 0)
+    {
+      fprintf (stderr, "Invalid arguments.\n");
+      exit (1);
+    }
+
+  // Seed from the clock, unless seeded.
+  if (!gen_seed)
+    {
+      struct timeval now;
+      gettimeofday (&now, NULL);
+      gen_seed = now.tv_sec * 1000000ULL + now.tv_usec;
+    }
+  print = PRINT_NONE;
+
+  if (gen_binary)
+    fputs (GRIDS_MAGIC, stdout);
+  if (gen_jobs > 1)
+    gen_parallel ();
+  else
+    {
+      long k;
+      for (k = 0; !gen_grids || k < gen_grids; k++)
+        {
+          int len;
+          unsigned char *rec = board_make (k, &len);
+          if (!rec)
+            no_board (k);
+          fwrite (rec, 1, len, stdout);
+          free (rec);
+        }
+    }
+  return 0;
+}
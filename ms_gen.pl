@@ -3,7 +3,7 @@
 
 my $ARGC = @ARGV;
 
-if ($ARGV[1] == "--help" || $ARGV[1] == "-h")
+if ($ARGV[0] eq "--help" || $ARGV[0] eq "-h")
 {
     print
 "Minesweeper grid generator usage:
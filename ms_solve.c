@@ -2,12 +2,32 @@
    Written by Chen Guo, UCLA CS 261A project spring 2011.
 */
 
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#ifdef MS_TRACE
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "ms_zdd.h"
 
 /* Defines. */
 #define INBUF_SIZ 1024
@@ -20,6 +40,53 @@
 #define UNKNOWN_CHAR '?'
 #define MINE_ON_CHAR '*'
 #define MINE_OFF_CHAR '-'
+#define GRIDS_MAGIC "MSGRIDS1\n"     // Start of a binary grid stream.
+#define GRIDS_TILES "012345678?*-"  // Tile of each 4 bit code in one.
+#define DD_MAX_NODES (1 << 26)
+#define CACHE_LINE 64
+#define STATS_BUCKETS 32
+#define TICK_NODES 1024             // Nodes between budget checks and
+                                    //   progress updates, a power of 2.
+#define ENGINE_PROBES 32            // Probes of the search tree to choose
+                                    //   an engine by.
+#define ENGINE_NODES (1 << 16)      // Estimated search nodes past which -a
+                                    //   counts with a decision diagram.
+#define AUTO_PROBES 8               // Probes of the search tree auto mode
+                                    //   takes, enough for its coarse rules.
+#define AUTO_NODES (1 << 14)        // Estimated search nodes past which
+                                    //   auto mode uses every thread.
+#define SPLIT_NODES 256             // Smallest estimated subtree handed to
+                                    //   a thread, when one is idle.
+#define WINDOW_STATES (1 << 20)     // Most boundary states window mode
+                                    //   keeps.
+#define WINDOW_ROWS 8               // Rows it holds, a power of 2 at least
+                                    //   the 5 a row's tiles are checked on.
+#define LANES 64                    // Grids lane mode solves at once, a bit
+                                    //   of a word each.
+#define LANE_TILES 1024             // Most tiles of a grid, inside the
+                                    //   border, that lane mode takes.
+#define ELIM_VARS 256               // Most unknowns eliminated together.
+#define ELIM_COEF (1LL << 30)       // Largest coefficient elimination
+                                    //   keeps, past which it gives up.
+#define BAND_TILES (1 << 18)        // Fewest tiles worth a thread of their
+                                    //   own when preprocessing.
+#define BAND_ROWS 4                 // Fewest rows in a band, so that bands
+                                    //   one apart never touch the same rows.
+#ifdef MS_TRACE
+#define TRACE_RING (1 << 20)        // Records kept per thread, a power of 2.
+#ifndef TRACE_FILE
+#define TRACE_FILE "ms_solve.trace"
+#endif
+#define TRACE(type, depth, val, arg) trace (type, depth, val, arg)
+#else
+#define TRACE(type, depth, val, arg)
+#endif
+#define SUM_MINE 1                  // A tile's part in 3x3 tile sums, which
+#define SUM_UNKNOWN (1 << 8)        //   count mines, unknowns and numbered
+#define SUM_NUMBER (1 << 16)        //   tiles in a byte each.
+#define SUM_MINES(s) ((s) & 0xff)
+#define SUM_UNKNOWNS(s) ((s) >> 8 & 0xff)
+#define SUM_NUMBERS(s) ((s) >> 16 & 0xff)
 #define LOCK {pthread_mutex_lock (thr_lock);}
 #define UNLOCK {pthread_mutex_unlock (thr_lock);}
 
@@ -44,12 +111,66 @@ struct buffers
   struct ind *ind;            // Array of indices to unknowns.
 };
 
+/* Decision stack entry: an unknown the search tries both states of. */
+struct frame
+{
+  int unknown;                // Unknown tried.
+  int mine_count;             // Mines before it.
+  int mark;                   // Length of the trail with it set off.
+  int goals;                  // Goal states found before it.
+  double weight;              // Fraction of the tree under it.
+  int state;                  // State tried: FRAME_OFF or FRAME_ON, or
+                              //   FRAME_GIVEN if on was handed to another
+                              //   thread.
+};
+
+enum { FRAME_OFF, FRAME_ON, FRAME_GIVEN };
+
 /* Individual thread data. */
 struct search
 {
   pthread_t thread;           // Thread object.
+  bool running;               // THREAD was started and not yet joined.
   bool avail;                 // Available flag.
   struct buffers bufs;        // Thread individual buffers used for search.
+  struct frame *stack;        // Decision stack, a frame per unknown.
+  int **trail;                // Tiles assigned, in order, to undo.
+  int *saved;                 // Room to set aside tiles of the trail.
+};
+
+/* Assignment prefix: the states of unknowns 0 to LEN-1 in search order, a
+   bit each, on which the subtree still to be searched hangs. */
+struct prefix
+{
+  int len;
+  int halves;                 // Unknowns on it the search tries both
+                              //   states of. Its subtree is 2^-HALVES of
+                              //   the tree, as counted by explored.
+  unsigned char *bits;
+};
+
+/* List of prefixes. */
+struct frontier
+{
+  int n;
+  int cap;
+  struct prefix *p;
+};
+
+/* Results of work units being merged. */
+struct merge
+{
+  char **files;
+  struct prefix *roots;       // Subtree each covers.
+  struct frontier *open;      // Subtrees under it each left open.
+};
+
+/* Prefix of a result being merged: the root of result RES, or with OPEN
+   not -1, the one of its open subtrees. */
+struct merge_item
+{
+  int res;
+  int open;
 };
 
 /* solve_tree () arguments for threading. */
@@ -58,13 +179,276 @@ struct thr_args
   int thread_num;             // Number of thread being used.
   int unknown_num;            // Number of unknown being inspected.
   int mine_count;             // Number of mines turned on thus far.
+  double weight;              // Fraction of the tree under UNKNOWN_NUM.
+  double est;                 // Nodes estimated under it, if split off,
+                              //   or -1.
+  struct prefix prefix;       // Assignment it hangs on, to replay onto the
+                              //   thread's grid, if split off.
+};
+
+/* Counts of a search's progress. */
+struct progress
+{
+  long long nodes;            // Assignments tried.
+  double explored;            // Fraction of the tree finished.
+  long long goals;            // Solutions found.
+};
+
+/* Search statistics of one thread slot. Only the thread holding the slot
+   updates them, and each is aligned to its own cache lines so that threads
+   don't contend for them. */
+struct stats
+{
+  long long nodes;            // Assignments tried.
+  long long consis_fails;     // Assignments failing the consistency check.
+  long long forced;           // Unknowns forced by resolve_tile ().
+  long long backtracks;       // Returns to an unknown to try its other state.
+  int max_depth;              // Deepest unknown assigned, plus one.
+  long long splits;           // Subtrees handed to another thread.
+  long long steals;           // Subtrees taken on from another thread.
+  long long declined;         // Subtrees kept from an idle thread as too
+                              //   small.
+  double split_ms;            // Time spent handing off subtrees.
+  double split_err;           // Error of the log2 estimate of the nodes
+                              //   of subtrees taken on, in absolute value.
+  double idle_ms;             // Time the slot was free.
+  double idle_since;          // When the slot was last freed.
+  double explored;            // Fraction of the tree finished. A node's
+                              //   fraction is its parent's, halved if its
+                              //   parent has two subtrees.
+  long long goals;            // Solutions claimed.
+  struct progress pub;        // Counts so far added into PROGRESS.
+  long long depth[STATS_BUCKETS];  // Assignments tried, by depth.
+  long long split_size[STATS_BUCKETS];  // Subtrees taken on, by log2 of
+                                        //   the nodes searched of them
+                                        //   here.
+} __attribute__ ((aligned (CACHE_LINE)));
+
+#ifdef MS_TRACE
+/* Trace events. */
+enum { TRACE_DECIDE, TRACE_FORCE, TRACE_CONFLICT, TRACE_SPLIT, TRACE_STEAL,
+       TRACE_DONE };
+
+/* Trace record. DEPTH is the unknown being assigned. For a decision, VAL is
+   its state and ARG is 1 if it was forced before being reached; for a force,
+   VAL is the state forced and ARG the number of unknowns; for a split, ARG
+   is the thread handed the subtree; for the end of a thread's work, ARG is
+   the goal states it found. */
+struct trace_rec
+{
+  uint64_t tsc;               // Time stamp counter.
+  int32_t depth;
+  uint8_t type;
+  uint8_t val;
+  uint16_t arg;
+};
+
+/* Ring of trace records of one thread slot. Only the thread holding the
+   slot appends to it, so it needs no lock; once full, the oldest records
+   are overwritten. */
+struct trace_ring
+{
+  uint64_t head;              // Records appended so far.
+  struct trace_rec *recs;
+} __attribute__ ((aligned (CACHE_LINE)));
+#endif
+
+/* Constraint from a numbered tile on the unknowns surrounding it. */
+struct constraint
+{
+  struct ind index;           // Index of numbered tile.
+  int need;                   // Mines still needed among VARS.
+  int nvars;                  // Number of surrounding unknowns.
+  int vars[8];                // Surrounding unknowns, as variable numbers.
+};
+
+/* Constraint system over the unknown tiles. Unknowns next to a numbered tile
+   are grouped into frontier components, which share no constraints with each
+   other. Unknowns next to no numbered tile are interior. */
+struct csp
+{
+  int nvars;                  // Number of variables (unknown tiles).
+  struct ind *vars;           // Index of each variable's tile.
+  int ncons;                  // Number of constraints.
+  struct constraint *cons;    // Constraints.
+  int *var_cons;              // Constraints of each variable. Variable V's
+  int *var_cons_start;        //   start at VAR_CONS_START[V].
+  int ncomps;                 // Number of frontier components.
+  int *comp;                  // Component of each variable, -1 if interior.
+  int *comp_vars;             // Frontier variables, grouped by component.
+  int *comp_start;            // Component C's variables start at
+                              //   COMP_START[C].
+  int nfrontier;              // Number of frontier variables.
+  int ninterior;              // Number of interior variables.
+  int *interior;              // Interior variables.
+  bool unsat;                 // A constraint can't be met by any assignment.
+};
+
+/* Search state over a constraint system. */
+struct csp_search
+{
+  struct csp *csp;
+  signed char *val;           // Variable values: -1 unassigned, 0 off, 1 on.
+  int *need;                  // Mines still needed by each constraint.
+  int *free;                  // Unassigned variables in each constraint.
+  int *trail;                 // Assigned variables, in order of assignment.
+  int ntrail;
+  int mines;                  // Mines among assigned variables.
+};
+
+/* Polynomial over the number of mines: C[K] weighs assignments with LO + K
+   mines. */
+struct poly
+{
+  int lo;                     // Fewest mines.
+  int len;                    // Number of coefficients, 0 if none.
+  double *c;                  // Coefficients.
+};
+
+/* Decision diagram over the variables of a frontier component, one level per
+   variable. A node stands for a residual subproblem: the partial assignments
+   of the levels above it that leave the same mines still needed by the
+   constraints that span it. Paths from the root to the terminal, the single
+   node on the last level, are the solutions of the component. */
+struct dd
+{
+  int nlevels;                // Number of variables.
+  int *vars;                  // Variable of each level.
+  int *level_start;           // Level L's nodes start at LEVEL_START[L].
+  int nnodes;                 // Number of nodes. The root is node 0.
+  int (*child)[2];            // Off and on child of each node, -1 if none.
+  bool by_mines;              // Counts are kept apart by number of mines.
+  struct poly *count;         // Solutions below each node.
+  double *count_scale;        // Log of the scale of each level's counts.
+  double **pool;              // Storage for each level's counts.
+};
+
+/* Counted decision diagram of a component, kept between the moves of
+   interactive mode. The key it's found by lists the number of variables,
+   the row and column of each in order, then the row, column and need of
+   each of the component's constraints. */
+struct dd_cache
+{
+  int *key;
+  int len;                    // Length of KEY.
+  unsigned int hash;          // Hash of KEY.
+  struct dd *dd;
+};
+
+/* Band of the rows inside the grid's border, preprocessed by a thread of
+   its own. The bands part the rows in order. */
+struct band
+{
+  int num;                    // Band number, and thread number meanwhile.
+  int first;                  // First row.
+  int last;                   // Row after the last.
+  void (*step) (struct band *);  // Step of preprocessing to run.
+  pthread_t thread;
+  struct band *above;         // Bands next to it, or NULL.
+  struct band *below;
+  int *sums;                  // Tile sums of the grid, or NULL.
+  int scan;                   // Offset in the grid of the next of its
+                              //   tiles to check in the first pass.
+  struct ind *todo[3];        // Tiles of its rows to check again, found by
+  int ntodo[3];               //   itself, by the band above and by the
+  int todo_cap[3];            //   band below.
+  int resolved;               // Unknowns pre-resolved.
+  bool unsat;                 // Pre-resolving left a numbered tile no way
+                              //   to meet it.
+  int mines;                  // Mines in its rows.
+  int unknowns;               // Unknowns in its rows.
+  int offset;                 // Index of its first unknown.
+  struct ind *ind;            // Index of all unknowns.
+  struct ind *sorted;         // Index of all unknowns, sorted.
+  unsigned char *keys;        // Sort keys of all unknowns.
+  int pos[9];                 // Its unknowns of each key, then where the
+                              //   next of them goes in SORTED.
+};
+
+/* Configuration raced in portfolio mode. */
+struct config
+{
+  const char *name;           // Options it stands for.
+  bool preresolve;
+  bool sort;
+  bool force;
+  bool shuffle;
+};
+
+/* Cheap measures of a grid, which auto mode picks a configuration by. */
+struct features
+{
+  int tiles;                  // Tiles inside the border.
+  int unknowns;
+  double blank;               // Fraction of the tiles that are unknown.
+  int frontier;               // Unknowns next to a numbered tile.
+  int comps;                  // Frontier components.
+  int largest;                // Unknowns in the largest of them.
+  double density;             // Numbered tiles per frontier unknown.
+  double tree;                // Estimated search tree, in nodes.
+};
+
+/* Rule of auto mode: the configuration for grids whose features are within
+   its bounds. */
+struct rule
+{
+  const char *name;           // Name logged when it is picked.
+  int goal;                   // GOAL_ONE, GOAL_COUNT or GOAL_ANY: the
+                              //   solutions wanted.
+  double min_tree;            // Fewest estimated nodes.
+  double max_tree;            // Most estimated nodes, or 0 for no limit.
+  bool preresolve;
+  bool sort;
+  bool force;
+  bool count;                 // Count by decision diagram, not search.
+  bool threads;               // Use all the threads given, else one.
+};
+
+/* State of window mode: the rows of the grid it holds, and the states of
+   the boundary between the unknowns assigned and the rest. A state's key
+   is the mines still needed by each numbered tile open there, a byte
+   each. Keys of a level are stored one after another. */
+struct window
+{
+  int *rows[WINDOW_ROWS];     // Rows held, by row number modulo
+                              //   WINDOW_ROWS.
+  int *slot_of;               // Key position of the tile at each column of
+                              //   the rows held, or -1 if not open.
+  int half;                   // For row_read ().
+  bool ended;                 // The text ended before the grid did.
+  int len;                    // Key length.
+  int nstates;
+  unsigned char *keys;
+  uint64_t *hash;             // Hash of each key.
+  long double *count;         // Assignments leading to each.
+  int nnext;                  // The same for the level being made.
+  unsigned char *next_keys;
+  uint64_t *next_hash;
+  long double *next_count;
+  size_t keys_cap;            // Bytes allocated for KEYS.
+  size_t next_cap;            // Bytes allocated for NEXT_KEYS.
+  int states_cap;             // States allocated for the rest.
+  int *table;                 // Hash table of the states being made.
+  int table_size;             // Its size in use, a power of 2.
+  int table_cap;              // Its size allocated.
+  int most;                   // Most states at once.
+  int scale;                  // Counts are to be doubled this many times.
 };
 
-/* Struct used for sorting unknown tiles. */
-struct sort_tile
+/* Grids of the same dimensions that lane mode solves together, each in a
+   lane: a bit of the masks of lanes. */
+struct lanes
 {
-  struct ind index;           // Index of unknown tile.
-  int number_tiles;           // Number of surrounding tiles with numbers.
+  int n;                      // Grids held.
+  int first;                  // Number of the first in the batch.
+  int rows;                   // Their dimensions, with the border.
+  int cols;
+  int *tiles;                 // Tiles of each grid, one after another.
+  int **grid;                 // Rows of one of them.
+  uint64_t *unknown;          // Lanes each tile is unknown in.
+  uint64_t *mine;             // Lanes each tile is a mine in.
+  long long goals[LANES];     // Solutions found of each.
+  int cap;                    // Tiles allocated for each grid.
 };
 
 /*****************************************************************************
@@ -83,6 +467,7 @@ static int goal_states = 0;      // Total goal states found, with constraints.
 /* Argument settings. */
 static bool force = false;       // Force unknown states during search.
 static bool preresolve = false;  // Preresolve uknowns before search.
+static bool eliminate = false;   // Fix unknowns by elimination too.
 static bool single = true;       // Find all solutions (opposed to just one)
 static bool sort = false;        // Sort unknown order.
 static int mine_target = -1;     // Number of desired mines in solution.
@@ -90,23 +475,148 @@ enum { PRINT_NONE, PRINT_MIN, PRINT_BASIC, PRINT_ALL, PRINT_DEBUG };
 static int print = PRINT_BASIC;   // Print boards.
 static int guess = false;
 static int diag = false;
+static bool query = false;       // Find forced unknowns instead of solutions.
+static bool prob = false;        // Find mine probabilities instead.
+static char *prob_file = NULL;   // Write probabilities here, in binary.
+static int samples = 0;          // Draw this many random solutions instead.
+static uint64_t rng_state = 0;   // Random number generator state.
+static char *zdd_file = NULL;    // Write the solution set here, as a ZDD.
+static bool interactive = false; // Read moves from standard input.
+static bool stats = false;       // Print search statistics.
+static bool batch = false;       // Solve every grid in the input.
+static long long node_budget = -1;  // Stop the search after this many nodes.
+static double time_budget = -1;  // Stop the search after this many ms.
+static bool budget_hit = false;  // A search was stopped by a budget.
+static int probes = 0;           // Estimate the search tree with this many
+                                 //   probes first.
+static double progress_secs = 0; // Report progress this often, in s.
+static char *ckpt_file = NULL;   // Write checkpoints of the search here.
+static double ckpt_secs = 60;    // Write one this often, in s.
+static char *resume_file = NULL; // Resume the search from this checkpoint.
+static char *cube_file = NULL;   // Split the search into work units here.
+static int cube_depth = 10;      // Branch levels to split it down.
+static double cube_nodes = 0;    // Or split it until each unit's estimated
+                                 //   tree is at most this many nodes.
+static char *unit_file = NULL;   // Solve the work unit in this file.
+static bool merge = false;       // Merge the results of work units.
+static bool binary_input = false;  // Input is a binary grid stream.
+static int portfolio = 0;        // Race this many configurations.
+static bool shuffle = false;     // Break ties in the sorted order at random.
+static bool window = false;      // Solve grids a few rows at a time.
+static bool lanes = false;       // Solve small grids of a batch together.
+
+/* Configurations portfolio mode races, in turn the least alike. Whichever
+   answers first is printed, so they must all give the same answer: only
+   ones that change how fast it is found belong here. Pre-resolving checks
+   the numbered tiles it resolves around for that. */
+static const struct config configs[] = {
+  {"", false, false, false, false},
+  {"-r -s", true, true, false, false},
+  {"-r -f", true, false, true, false},
+  {"-r -s --shuffle", true, true, false, true},
+  {"-s", false, true, false, false},
+  {"-f", false, false, true, false},
+  {"-r", true, false, false, false},
+  {"-r -s -f --shuffle", true, true, true, true},
+};
+#define NCONFIGS (int) (sizeof configs / sizeof configs[0])
+static bool auto_config = false; // Pick the configuration from the grid.
+static bool count_dd = false;    // Count solutions by decision diagram,
+                                 //   without estimating the search first.
+enum { GOAL_ANY, GOAL_ONE, GOAL_COUNT };
+
+/* Rules of auto mode. The first whose bounds a grid is within picks its
+   configuration, so the last must take any. Timed on boards 10 to 30 tiles
+   a side and 40 to 70% unknown, pre-resolving and forcing was the fastest
+   or close to it on nearly all, where sorting took up to 100 times as
+   long to count, and a decision diagram counted faster than the search
+   once the tree estimated before pre-resolving passed ENGINE_NODES. A rule
+   picks how the answer is found, never what it is, so any configuration
+   may be used: pre-resolving checks the numbered tiles it resolves around,
+   and preprocessing checks them all. */
+static const struct rule auto_rules[] = {
+  {"count", GOAL_COUNT, ENGINE_NODES, 0, true, false, false, true, true},
+  {"small", GOAL_ANY, 0, AUTO_NODES, true, false, true, false, false},
+  {"large", GOAL_ANY, 0, 0, true, false, true, false, true},
+};
 
 /* For thread control */
 static int max_threads = 1;      // Threads to use.
-static int avail_threads = 1;    // Available threads.
+static atomic_int avail_threads = 1;  // Available threads. Changed
+                                      //   under THR_LOCK only.
+static double split_nodes = SPLIT_NODES;  // Split subtrees estimated at
+                                          //   this many nodes or more.
 static struct search *thr_data;  // Array of search data, for threads.
+static int (*solve_tree) (int, int, bool);  // Variant of the search for
+                                            //   the options.
 static pthread_mutex_t *thr_lock;    // Thread control mutex.
 static pthread_cond_t *thr_cond; // Thread control cond var.
+static struct stats *thr_stats;  // Search statistics, for threads.
+static atomic_bool search_stop;  // The one solution wanted was found, or
+                                 //   a budget ran out.
+static atomic_bool budget_out;   // A budget ran out.
+static double budget_deadline;   // When the time budget runs out.
+static bool ticking;             // Threads publish their progress every
+                                 //   TICK_NODES nodes.
+static struct progress progress; // Published progress of all threads, under
+                                 //   THR_LOCK.
+static pthread_mutex_t monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond = PTHREAD_COND_INITIALIZER;
+static bool monitor_done;        // The search is over, under MONITOR_LOCK.
+static atomic_bool ckpt_wanted;  // Threads are to check in for a
+                                 //   checkpoint.
+static int ckpt_in;              // Threads checked in, under THR_LOCK.
+static int ckpt_gen;             // Checkpoints written, under THR_LOCK.
+static struct frontier ckpt_open;  // Prefixes the threads checked in have
+                                   //   yet to search, under THR_LOCK.
+static struct frontier resume_open;  // Prefixes to search when resuming.
+static int resume_next;          // Next of them to search, under THR_LOCK.
+static int *ckpt_grid;           // Grid the search starts from.
+static uint64_t ckpt_key;        // Hash of it and the options that shape
+                                 //   the search tree.
+static long long ckpt_goals;     // Goal states found before resuming.
+static long long ckpt_nodes;     // Nodes tried before resuming.
+static double ckpt_done;         // Share of the tree done before resuming.
+static struct prefix ckpt_root;  // Subtree the checkpoints cover, the whole
+                                 //   tree unless a work unit's.
+#ifdef MS_TRACE
+static struct trace_ring *thr_trace;  // Trace rings, for threads.
+static uint64_t trace_tsc0;      // Time stamp counter and time at the start,
+static double trace_ms0;         //   to scale time stamps to time.
+#endif
+static int (*sum_code) (const int *, int *, int, int *, int *);  // Tile
+                                 //   sum kernels for the CPU, or NULL
+                                 //   until sum_select () picks them.
+static void (*sum_add3) (const int *, const int *, const int *, int *, int);
 static __thread int thread_num;  // Thread number.
+static __thread double tree_weight;  // Fraction of the tree under the
+                                     //   unknown being inspected.
+static __thread long long split_recheck;  // Nodes searched before a
+                                          //   subtree is probed for a
+                                          //   split again.
+static __thread int stack_len;   // Frames on the thread's decision stack.
+static __thread int **trail;     // Tiles assigned by the search, in order,
+                                 //   or NULL if it keeps none.
+static __thread int trail_len;   // Tiles on the trail.
+static __thread uint64_t split_rng;  // Random numbers for split probes.
 
 /* Function prototypes. */
 /* Preprocess functions. */
 static void preprocess_grid ();
+static int tile_sums (int **, int *, struct ind *, int *, int, int);
+static void sum_select ();
 
 /* Grid solver functions. */
+static void solve_grid ();
+static void portfolio_solve ();
+static void auto_select ();
+static void search ();
 static void * solve_tree_thr (void *);
-static int solve_tree (int, int, struct buffers);
-static int solve_subtree (int, int, struct buffers, bool);
+static void tree_select ();
+static void split_bottom (struct frame *, int *);
+static double sibling_probe (struct frame *);
+static inline void trail_push (int *);
+static inline void trail_undo (int);
 static bool consistency_check (struct ind, int **, int, bool);
 static int find_unknowns (int **, struct ind *);
 static void clear_unknowns (int, struct ind *, int **);
@@ -114,26 +624,135 @@ static inline int force_on (int);
 static inline int force_off (int);
 static inline bool is_mine (int);
 static inline int mine_src (int);
+static inline void stats_node (int);
+static inline void tree_done ();
+static void search_run (int, int, double);
+static double tree_probe (int **, struct ind *, int, int, double,
+                          uint64_t *, long long *);
+static void tree_estimate (int, int, int, double *, double *, double *);
+static void search_tick (int);
+static void progress_publish (struct stats *);
+static void * monitor_thr (void *);
+static inline bool two_branch (int, int);
+static struct prefix * frontier_push (struct frontier *);
+static void frontier_add (struct frontier *, int **, struct ind *, int,
+                          bool, int);
+static void ckpt_check_in (int);
+static void ckpt_ready ();
+static void ckpt_setup ();
+static void ckpt_write (char *, struct frontier *);
+static bool ckpt_header (FILE *, uint64_t *, int *, long long *,
+                         long long *, double *, int *);
+static void ckpt_load ();
+static void prefix_make (struct prefix *, int **, struct ind *, int, bool,
+                         int);
+static bool prefix_replay (struct buffers, struct prefix *, int *);
+static int prefix_branch (struct buffers, struct prefix *, int *);
+static void cube_split ();
+static void unit_open (char *);
+static void merge_results (char **, int);
+static bool merge_left (struct merge_item *, int, int);
+static void merge_walk (struct merge *, struct prefix *, struct merge_item *,
+                        int, int, bool);
+static void budget_report (int **);
+static bool plan_search ();
+static bool count_only ();
+static inline bool goal_claim ();
+
+/* Constraint system functions. */
+static struct csp * csp_build (int **, struct ind *, int);
+static void csp_free (struct csp *);
+static void query_forced (int **);
+static int eliminate_grid (int **, bool *);
+static void eliminate_system (struct csp *, int *, int, int, int *,
+                              signed char *);
+
+/* Counting functions. */
+static void dd_free (struct dd *);
+static void prob_map (int **);
+static void sample_solutions (int **);
+static inline double rng_uniform (uint64_t *);
+static double rng_double ();
+static long double dd_goal_count (int **);
+static void zdd_solutions (int **);
+static void interactive_solve (int **);
+
+/* Window functions. */
+static void window_solve (FILE *);
+static inline uint64_t window_mix (int, int);
+static inline int window_tile (struct window *, int, int);
+static void window_load (struct window *, FILE *, int);
+static bool window_check (struct window *, int, int);
+static void window_add (struct window *, int, uint64_t, long double);
+static void window_step (struct window *, int, int);
+static void window_compact (struct window *);
+
+/* Lane functions. */
+static bool lanes_add (struct lanes *, FILE *, int);
+static void lanes_solve (struct lanes *);
+static void lanes_search (struct lanes *);
 
 /* Thread control functions. */
 static void thread_alloc ();
 static void thread_struct_alloc ();
 static int thread_find ();
 static void thread_free ();
-static void thread_copy (int, int);
+static void stats_print (double, double, double);
+#ifdef MS_TRACE
+static inline uint64_t trace_tsc ();
+static inline void trace (int, int, int, int);
+static void trace_write ();
+#endif
 
 /* Misc functions. */
 static void diag_print (struct ind *, int **);
 static void board_print (int **);
+static double now_ms ();
+#ifdef main
+static char * grid_random (int, int, int, int);
+#endif
 static void parse_input (char *);
-static void help ();
+static void batch_solve (char *);
+static FILE * input_open (char *);
+static bool input_next (FILE *);
+static void dims_read (FILE *);
+static bool row_read (FILE *, char *, int *);
+static inline int tile_value (char);
+static void parse_stream (FILE *);
+static void grid_parse (FILE *);
+static void grid_read (FILE *, int **);
+static void help () __attribute__ ((noreturn));
 
 
 int main (int argc, char **argv)
 {
-  // Parse arguments.
-  char c;
-  while ((c = getopt (argc, argv, "adfhm:p:rst:")) != -1)
+  // Parse arguments. Options without a letter are numbered past the
+  // letters.
+  enum { OPT_AUTO = 256, OPT_CHECKPOINT, OPT_CHECKPOINT_EVERY, OPT_CUBE,
+         OPT_CUBE_DEPTH, OPT_CUBE_NODES, OPT_ELIMINATE, OPT_LANES,
+         OPT_MERGE, OPT_PORTFOLIO, OPT_RESUME, OPT_SHUFFLE, OPT_SPLIT_NODES,
+         OPT_UNIT, OPT_WINDOW };
+  static const struct option long_opts[] = {
+    {"auto", no_argument, NULL, OPT_AUTO},
+    {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+    {"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+    {"cube", required_argument, NULL, OPT_CUBE},
+    {"cube-depth", required_argument, NULL, OPT_CUBE_DEPTH},
+    {"cube-nodes", required_argument, NULL, OPT_CUBE_NODES},
+    {"eliminate", no_argument, NULL, OPT_ELIMINATE},
+    {"lanes", no_argument, NULL, OPT_LANES},
+    {"merge", no_argument, NULL, OPT_MERGE},
+    {"portfolio", required_argument, NULL, OPT_PORTFOLIO},
+    {"resume", required_argument, NULL, OPT_RESUME},
+    {"shuffle", no_argument, NULL, OPT_SHUFFLE},
+    {"split-nodes", required_argument, NULL, OPT_SPLIT_NODES},
+    {"unit", required_argument, NULL, OPT_UNIT},
+    {"window", no_argument, NULL, OPT_WINDOW},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+  while ((c = getopt_long (argc, argv, "abde:fhik:m:N:o:p:PqrR:sSt:T:v:Z:",
+                           long_opts, NULL)) != -1)
     {
       switch (c)
         {
@@ -142,12 +761,22 @@ int main (int argc, char **argv)
           single = false;
           break;
 
+          // Solve every grid in the input.
+        case 'b':
+          batch = true;
+          break;
+
           // Diagnostic: print state of blank and sum of surrounding tiles.
           // Note: don't put this in -h message.
         case 'd':
           diag = true;
           break;
 
+          // Estimate the search tree first.
+        case 'e':
+          probes = atoi (optarg);
+          break;
+
           // Force unknown state during search.
         case 'f':
           force = true;
@@ -163,107 +792,594 @@ int main (int argc, char **argv)
         case 'h':
           help ();
 
+          // Take moves from standard input.
+        case 'i':
+          interactive = true;
+          break;
+
+          // Draw random solutions.
+        case 'k':
+          samples = atoi (optarg);
+          break;
+
           // Target number of mines.
         case 'm':
           mine_target = atoi (optarg);
           break;
 
+          // Node budget of the search.
+        case 'N':
+          node_budget = atoll (optarg);
+          break;
+
+          // Write output to file.
+        case 'o':
+          prob_file = optarg;
+          break;
+
           // Print.
         case 'p':
           print = atoi (optarg);
           break;
 
+          // Find the probability of each unknown being a mine.
+        case 'P':
+          prob = true;
+          break;
+
+          // Query which unknowns are forced on or off.
+        case 'q':
+          query = true;
+          break;
+
           // Pre-resolve unknowns.
         case 'r':
           preresolve = true;
           break;
 
+          // Seed for random numbers.
+        case 'R':
+          rng_state = strtoull (optarg, NULL, 10);
+          break;
+
           // Sort unknowns by number of surrounding tiles.
         case 's':
           sort = true;
           break;
 
+          // Print search statistics.
+        case 'S':
+          stats = true;
+          break;
+
           // Threads tp use.
         case 't':
           max_threads = atoi(optarg);
           // Current thread is a thread, so max-1 are available.
           avail_threads = max_threads;
           break;
+
+          // Time budget of the search.
+        case 'T':
+          time_budget = atof (optarg);
+          break;
+
+          // Report progress while searching.
+        case 'v':
+          progress_secs = atof (optarg);
+          break;
+
+          // Write the set of all solutions to a file.
+        case 'Z':
+          zdd_file = optarg;
+          break;
+
+          // Pick the configuration from the grid.
+        case OPT_AUTO:
+          auto_config = true;
+          break;
+
+          // Checkpoint the search.
+        case OPT_CHECKPOINT:
+          ckpt_file = optarg;
+          break;
+
+        case OPT_CHECKPOINT_EVERY:
+          ckpt_secs = atof (optarg);
+          break;
+
+          // Split the search into work units.
+        case OPT_CUBE:
+          cube_file = optarg;
+          break;
+
+        case OPT_CUBE_DEPTH:
+          cube_depth = atoi (optarg);
+          break;
+
+        case OPT_CUBE_NODES:
+          cube_nodes = atof (optarg);
+          break;
+
+          // Fix unknowns by elimination before search.
+        case OPT_ELIMINATE:
+          eliminate = true;
+          break;
+
+          // Solve small grids of a batch together.
+        case OPT_LANES:
+          lanes = true;
+          break;
+
+          // Merge the results of work units.
+        case OPT_MERGE:
+          merge = true;
+          break;
+
+          // Race configurations for the answer.
+        case OPT_PORTFOLIO:
+          portfolio = atoi (optarg);
+          break;
+
+          // Resume the search from a checkpoint.
+        case OPT_RESUME:
+          resume_file = optarg;
+          break;
+
+          // Break ties in the sorted order at random.
+        case OPT_SHUFFLE:
+          shuffle = true;
+          break;
+
+          // Smallest subtree to hand to another thread.
+        case OPT_SPLIT_NODES:
+          split_nodes = atof (optarg);
+          break;
+
+          // Solve a work unit. It is resumed like a checkpoint.
+        case OPT_UNIT:
+          unit_file = optarg;
+          resume_file = optarg;
+          break;
+
+          // Solve grids a few rows at a time.
+        case OPT_WINDOW:
+          window = true;
+          break;
         }
     }
 
+  // Seed random numbers from the clock, unless seeded. Zero would be stuck
+  // at zero.
+  if (!rng_state)
+    {
+      struct timeval now;
+      gettimeofday (&now, NULL);
+      rng_state = now.tv_sec * 1000000ULL + now.tv_usec;
+    }
+
+  if (batch && interactive)
+    {
+      fprintf (stderr, "Interactive mode can't be used with -b.\n");
+      exit (1);
+    }
+  if (batch && (ckpt_file || resume_file || cube_file || merge))
+    {
+      fprintf (stderr, "Checkpoints and work units can't be used with -b.\n");
+      exit (1);
+    }
+  if (ckpt_secs <= 0)
+    {
+      fprintf (stderr, "Invalid checkpoint interval.\n");
+      exit (1);
+    }
+  if (cube_depth < 0 || cube_nodes < 0 || split_nodes <= 0)
+    {
+      fprintf (stderr, "Invalid work unit or split size.\n");
+      exit (1);
+    }
+  if (shuffle && (ckpt_file || resume_file || cube_file))
+    {
+      fprintf (stderr, "Checkpoints and work units can't be used with "
+               "--shuffle.\n");
+      exit (1);
+    }
+  if (auto_config && (ckpt_file || resume_file || cube_file))
+    {
+      fprintf (stderr, "Checkpoints and work units can't be used with "
+               "--auto.\n");
+      exit (1);
+    }
+  if (auto_config && (portfolio || interactive || query || prob || samples
+                      || zdd_file))
+    {
+      fprintf (stderr, "Auto mode only configures searches.\n");
+      exit (1);
+    }
+  if (portfolio < 0 || portfolio > NCONFIGS)
+    {
+      fprintf (stderr, "Invalid portfolio size.\n");
+      exit (1);
+    }
+  if (portfolio && (batch || interactive || query || prob || samples
+                    || zdd_file || ckpt_file || resume_file || cube_file
+                    || merge))
+    {
+      fprintf (stderr, "Portfolio mode only races searches.\n");
+      exit (1);
+    }
+
+  if (window && (mine_target != -1 || interactive || query || prob
+                 || samples || zdd_file || ckpt_file || resume_file
+                 || cube_file || merge || portfolio || auto_config))
+    {
+      fprintf (stderr, "Window mode only finds or counts solutions, with "
+               "no mine target.\n");
+      exit (1);
+    }
+
+  if (lanes && (!batch || window || interactive || query || prob
+                || samples || zdd_file || auto_config || diag || stats
+                || print >= PRINT_ALL || node_budget >= 0
+                || time_budget >= 0))
+    {
+      fprintf (stderr, "Lane mode only finds or counts the solutions of "
+               "batches.\n");
+      exit (1);
+    }
+
   int num_goals = 0;
-  char *file = argv[optind];
+  char *file = unit_file ? unit_file : argv[optind];
   if (print >= PRINT_BASIC)
-    printf ("Processing file %s\n", file);
+    printf ("Processing file %s\n", file ? file : "-");
 
-  // Allocate structures for threads.
-  thread_alloc ();
+  if (batch)
+    batch_solve (file);
+  else if (merge)
+    merge_results (argv + optind, argc - optind);
+  else if (window)
+    {
+      FILE *fh = input_open (file);
+      window_solve (fh);
+      if (fh != stdin)
+        fclose (fh);
+    }
+  else
+    {
+      // Allocate structures for threads.
+      thread_alloc ();
+
+      // Parse the input file, or the grid of a work unit. The buffers for
+      // each thread structure is allocated here.
+      if (unit_file)
+        unit_open (unit_file);
+      else
+        parse_input (file);
+      if (portfolio)
+        portfolio_solve ();
+      else
+        solve_grid ();
 
-  // Parse the input file. The buffers for each thread structure
-  // is allocated here.
-  parse_input (file);
+      // Free thread resources.
+      thread_free ();
+    }
+
+  // A search cut short by a budget gave partial results.
+  return budget_hit ? 2 : 0;
+}
 
+/* Solve the grid parsed into thread 0's buffers, as the options say, and
+   print the results. */
+static void solve_grid ()
+{
   // Begin processing file. Start timer.
   struct timeval timer_start, timer_pre, timer_end;
   double total_time, pre_time, search_time;
-  if (print >= PRINT_MIN)
+  bool counted = false;
+  int threads = max_threads;
+  if (print >= PRINT_MIN || stats)
     gettimeofday (&timer_start, NULL);
+  budget_deadline = now_ms () + time_budget;
+  if (auto_config)
+    auto_select ();
 
   // Preprocess the grid to prepare for search. Assigns global value
   // TOTAL_UNKNOWNS.
   preprocess_grid ();
-  if (print >= PRINT_MIN)
+  if (print >= PRINT_MIN || stats)
     gettimeofday (&timer_pre, NULL);
 
   // NOTE: in defines, mapping tile values to 1000000 - 1000008 assumes that
   // there will NEVER be more than 1 million unknowns.
-  if (total_unknowns >= 1000000)
+  if (interactive)
+    interactive_solve (thr_data[0].bufs.grid);
+  else if (query)
+    query_forced (thr_data[0].bufs.grid);
+  else if (prob)
+    prob_map (thr_data[0].bufs.grid);
+  else if (samples > 0)
+    sample_solutions (thr_data[0].bufs.grid);
+  else if (zdd_file)
+    zdd_solutions (thr_data[0].bufs.grid);
+  else if (total_unknowns >= 1000000)
     fprintf (stderr, "Too many unknowns, search not performed.\n");
-  else if (total_unknowns > 0)
+  else if (cube_file)
+    cube_split ();
+  else if (total_unknowns > 0 && plan_search ())
+    counted = true;
+  else if (total_unknowns > 0 && (node_budget >= 0 || time_budget >= 0))
     {
-      // Attempt to find a solution, or multiple solutions.
-      // Spin off search thread in thread 0, and wait.
-      struct thr_args args = {0, 0, 0};
-      pthread_t thread;
-      LOCK;
-      pthread_create (&thread, NULL, solve_tree_thr, &args);
-      pthread_detach (thread);
-      pthread_cond_wait (thr_cond, thr_lock);
-      UNLOCK;
+      // The search works on thread 0's grid, so keep the grid as it starts
+      // out for the report.
+      int *buf = (int *) malloc (ntiles * sizeof (int));
+      int **grid = (int **) malloc (nrows * sizeof (int *));
+      int i;
+      memcpy (buf, thr_data[0].bufs.buf, ntiles * sizeof (int));
+      for (i = 0; i < nrows; i++)
+        grid[i] = buf + i * ncols;
+      search ();
+      if (atomic_load (&budget_out))
+        {
+          budget_hit = true;
+          if (print >= PRINT_MIN)
+            budget_report (grid);
+        }
+      free (grid);
+      free (buf);
     }
+  else if (total_unknowns > 0 || resume_file)
+    search ();
   else
     {
-      // Trivially a goal state.
-      if (print >= PRINT_ALL)
-        board_print (thr_data[0].bufs.grid);
-      goal_states++;
+      // Trivially a goal state, if the mine target is met.
+      if (mine_target == -1 || mine_target == 0)
+        {
+          if (print >= PRINT_ALL)
+            board_print (thr_data[0].bufs.grid);
+          goal_states++;
+        }
     }
 
-  if (print >= PRINT_BASIC)
+  if (print >= PRINT_BASIC && !interactive && !query && !prob && !samples
+      && !zdd_file && !cube_file && !counted)
     printf ("Number of goal states: %d\n", goal_states);
 
   // Find elapsed time in us.
-  if (print >= PRINT_MIN)
+  if (print >= PRINT_MIN || stats)
     {
       gettimeofday (&timer_end, NULL);
 
       pre_time = (timer_pre.tv_sec * 1000.0) + (timer_pre.tv_usec/1000.0)
         - (timer_start.tv_sec * 1000.0) - (timer_start.tv_usec / 1000.0);
-      printf ("Preprocess time: %f ms\n", pre_time);
-
       search_time = (timer_end.tv_sec * 1000.0) + (timer_end.tv_usec/1000.0)
         - (timer_pre.tv_sec * 1000.0) - (timer_pre.tv_usec / 1000.0);
-      printf ("Search time: %f ms\n", search_time);
-
-
       total_time = (timer_end.tv_sec * 1000.0) + (timer_end.tv_usec/1000.0)
         - (timer_start.tv_sec * 1000.0) - (timer_start.tv_usec / 1000.0);
+    }
+  if (print >= PRINT_MIN)
+    {
+      printf ("Preprocess time: %f ms\n", pre_time);
+      printf ("Search time: %f ms\n", search_time);
       printf ("Elapsed time: %f ms\n", total_time);
     }
+  if (stats)
+    stats_print (pre_time, search_time, total_time);
+#ifdef MS_TRACE
+  trace_write ();
+#endif
+
+  // Give back the threads auto mode left out.
+  avail_threads += threads - max_threads;
+  max_threads = threads;
+}
+
+
+
+/* Race the first PORTFOLIO configurations on the grid parsed, each in a
+   process of its own, as the solver keeps its state in globals, with an
+   equal share of the threads. The output of the first to answer is printed,
+   as all of CONFIGS give the same answer, and the others are killed. One
+   stopped by a budget has not answered; if none answer, the output of the
+   last to stop is printed. */
+static void portfolio_solve ()
+{
+  int n = portfolio;
+  int share = max_threads / n > 1 ? max_threads / n : 1;
+  struct pollfd *fds = (struct pollfd *) malloc (n * sizeof *fds);
+  pid_t *pids = (pid_t *) malloc (n * sizeof (pid_t));
+  char **out = (char **) calloc (n, sizeof (char *));
+  size_t *len = (size_t *) calloc (n, sizeof (size_t));
+  size_t *cap = (size_t *) calloc (n, sizeof (size_t));
+  uint64_t seed = rng_state;
+  int i, k;
+
+  fflush (stdout);
+  for (i = 0; i < n; i++)
+    {
+      int fd[2];
+      if (pipe (fd))
+        {
+          fprintf (stderr, "Could not create pipe.\n");
+          exit (1);
+        }
+      pids[i] = fork ();
+      if (pids[i] < 0)
+        {
+          fprintf (stderr, "Could not fork.\n");
+          exit (1);
+        }
+      if (!pids[i])
+        {
+          // Solve with the configuration, and print down the pipe. Each
+          // configuration draws its own random numbers.
+          for (k = 0; k < i; k++)
+            close (fds[k].fd);
+          close (fd[0]);
+          dup2 (fd[1], STDOUT_FILENO);
+          close (fd[1]);
+          preresolve = configs[i].preresolve;
+          sort = configs[i].sort;
+          force = configs[i].force;
+          shuffle = configs[i].shuffle;
+          rng_state = seed + i;
+          max_threads = share;
+          avail_threads = share - 1;
+          solve_grid ();
+          fflush (stdout);
+          _exit (budget_hit ? 2 : 0);
+        }
+      close (fd[1]);
+      fds[i].fd = fd[0];
+      fds[i].events = POLLIN;
+    }
+
+  // Gather what each prints until one answers. Poll skips the pipes
+  // closed, set to -1.
+  int winner = -1;
+  int last = -1;
+  int open = n;
+  while (open > 0 && winner < 0)
+    {
+      poll (fds, n, -1);
+      for (i = 0; i < n && winner < 0; i++)
+        {
+          if (fds[i].fd < 0 || !fds[i].revents)
+            continue;
+          if (len[i] == cap[i])
+            {
+              cap[i] = cap[i] ? 2 * cap[i] : 4096;
+              out[i] = (char *) realloc (out[i], cap[i]);
+            }
+          ssize_t got = read (fds[i].fd, out[i] + len[i], cap[i] - len[i]);
+          if (got > 0)
+            {
+              len[i] += got;
+              continue;
+            }
+
+          // Done printing, so done.
+          int status;
+          close (fds[i].fd);
+          fds[i].fd = -1;
+          open--;
+          waitpid (pids[i], &status, 0);
+          pids[i] = 0;
+          last = i;
+          if (WIFEXITED (status) && !WEXITSTATUS (status))
+            winner = i;
+        }
+    }
 
-  // Free thread resources.
-  //thread_free ();
+  // Cancel the rest.
+  for (i = 0; i < n; i++)
+    if (pids[i] > 0)
+      {
+        kill (pids[i], SIGKILL);
+        waitpid (pids[i], NULL, 0);
+        close (fds[i].fd);
+      }
+
+  int shown = winner >= 0 ? winner : last;
+  if (print >= PRINT_MIN)
+    {
+      printf ("%s by: %s%s-t %d", winner >= 0 ? "Answered first"
+              : "No answer, last stopped", configs[shown].name,
+              *configs[shown].name ? " " : "", share);
+      if (configs[shown].shuffle)
+        printf (" -R %llu", (unsigned long long) (seed + shown));
+      printf ("\n");
+    }
+  fwrite (out[shown], 1, len[shown], stdout);
+  budget_hit = winner < 0;
+
+  for (i = 0; i < n; i++)
+    free (out[i]);
+  free (out);
+  free (len);
+  free (cap);
+  free (fds);
+  free (pids);
+}
+
+
+
+/* Pick the configuration to solve the grid parsed with, by the first of
+   AUTO_RULES its features are within, and log it. The features are quick
+   to take: counts of the tiles, the constraints the numbered tiles make,
+   and an estimate of the search tree with forcing, in row order, from
+   AUTO_PROBES probes. Sets -r, -s and -f, whether to count with a
+   decision diagram, and the threads, which solve_grid () gives back. */
+static void auto_select ()
+{
+  int **grid = thr_data[0].bufs.grid;
+  struct ind *ind = thr_data[0].bufs.ind;
+  struct features feat;
+  int mines = 0;
+  int i, j;
+
+  memset (&feat, 0, sizeof feat);
+  feat.tiles = (nrows - 2) * (ncols - 2);
+  feat.unknowns = find_unknowns (grid, ind);
+  feat.blank = feat.tiles ? (double) feat.unknowns / feat.tiles : 0;
+  for (i = 1; i < nrows - 1; i++)
+    for (j = 1; j < ncols - 1; j++)
+      mines += is_mine (grid[i][j]);
+
+  struct csp *csp = csp_build (grid, ind, feat.unknowns);
+  feat.frontier = csp->nfrontier;
+  feat.comps = csp->ncomps;
+  for (i = 0; i < csp->ncomps; i++)
+    if (feat.largest < csp->comp_start[i+1] - csp->comp_start[i])
+      feat.largest = csp->comp_start[i+1] - csp->comp_start[i];
+  feat.density = feat.frontier ? (double) csp->ncons / feat.frontier : 0;
+  csp_free (csp);
+
+  // The probes take the mine target less the mines placed, as the search
+  // does, and are made as -f searches. Preprocessing finds the unknowns
+  // again after.
+  if (feat.unknowns > 0 && feat.unknowns < 1000000)
+    {
+      int target = mine_target;
+      bool forcing = force;
+      double err, ms;
+      if (mine_target > -1)
+        mine_target = mine_target >= mines ? mine_target - mines : -2;
+      total_unknowns = feat.unknowns;
+      force = true;
+      tree_estimate (0, 0, AUTO_PROBES, &feat.tree, &err, &ms);
+      mine_target = target;
+      force = forcing;
+    }
+
+  int goal = !single ? GOAL_COUNT : GOAL_ONE;
+  if (goal == GOAL_COUNT && !count_only ())
+    goal = GOAL_ANY;
+  const struct rule *r = auto_rules;
+  while ((r->goal != GOAL_ANY && r->goal != goal) || feat.tree < r->min_tree
+         || (r->max_tree > 0 && feat.tree >= r->max_tree))
+    r++;
+
+  preresolve = r->preresolve;
+  sort = r->sort;
+  force = r->force;
+  count_dd = r->count;
+  if (!r->threads)
+    {
+      avail_threads -= max_threads - 1;
+      max_threads = 1;
+    }
+
+  if (print >= PRINT_MIN)
+    {
+      printf ("Features: %d tiles, %d unknowns (%.1f%%), %d on the frontier "
+              "in %d components (largest %d), %.2f numbers per frontier "
+              "unknown, search tree about %.3g nodes\n", feat.tiles,
+              feat.unknowns, 100 * feat.blank, feat.frontier, feat.comps,
+              feat.largest, feat.density, feat.tree);
+      printf ("Auto rule %s: %s%s%s-t %d%s\n", r->name,
+              preresolve ? "-r " : "", sort ? "-s " : "", force ? "-f " : "",
+              max_threads, count_dd ? ", counting by decision diagram" : "");
+    }
 }
 
 
@@ -323,6 +1439,7 @@ static int resolve_tile (int row, int col, int **grid, int source, bool rec)
         {
           if (print >= PRINT_DEBUG)
             fprintf (stderr, "[%d][%d] forced on\n", ind[k].row, ind[k].col);
+          trail_push (&grid[ind[k].row][ind[k].col]);
           grid[ind[k].row][ind[k].col] = force_on (source);
         }
     }
@@ -334,12 +1451,15 @@ static int resolve_tile (int row, int col, int **grid, int source, bool rec)
         {
           if (print >= PRINT_DEBUG)
             fprintf (stderr, "[%d][%d] forced off\n", ind[k].row, ind[k].col);
+          trail_push (&grid[ind[k].row][ind[k].col]);
           grid[ind[k].row][ind[k].col] = force_off (source);
         }
     }
   else
     return 0;
 
+  thr_stats[thread_num].forced += unknowns;
+  TRACE (TRACE_FORCE, source, turn_on, unknowns);
   resolved = unknowns;
   return resolved;
 
@@ -560,17 +1680,219 @@ static int resolve_tile (int row, int col, int **grid, int source, bool rec)
   return resolved;
 }
 
-/* This function attempts to resolve some unknown tiles before we start the
-   search. Essentially, this will reduce the depth of the search tree. */
-static int preresolve_grid ()
+/* Queue the tile at ROW, COL on list LIST of band B's tiles to check
+   again. */
+static void band_todo (struct band *b, int list, int row, int col)
 {
+  if (b->ntodo[list] == b->todo_cap[list])
+    {
+      b->todo_cap[list] = b->todo_cap[list] ? 2 * b->todo_cap[list] : 64;
+      b->todo[list] = (struct ind *)
+        realloc (b->todo[list], b->todo_cap[list] * sizeof (struct ind));
+    }
+  b->todo[list][b->ntodo[list]].row = row;
+  b->todo[list][b->ntodo[list]++].col = col;
+}
+
+/* Returns whether tile TILE_NUM, with the tile sum S, resolves any
+   unknowns. */
+static inline bool sum_resolves (int tile_num, int s)
+{
+  return 0 <= tile_num && tile_num <= 8 && SUM_UNKNOWNS (s)
+    && (tile_num == SUM_MINES (s)
+        || tile_num == SUM_MINES (s) + SUM_UNKNOWNS (s));
+}
+
+/* Returns whether the tile at ROW, COL of GRID, if it is numbered, can still
+   have its number of mines around it. */
+static bool tile_fits (int **grid, int row, int col)
+{
+  int tile_num = grid[row][col];
+  int mines = 0;
+  int unknowns = 0;
   int i, j;
-  int resolved = 0;
+  if (tile_num < 0 || tile_num > 8)
+    return true;
+  for (i = row - 1; i <= row + 1; i++)
+    for (j = col - 1; j <= col + 1; j++)
+      {
+        if (is_mine (grid[i][j]))
+          mines++;
+        else if (grid[i][j] == UNKNOWN)
+          unknowns++;
+      }
+  return mines <= tile_num && tile_num <= mines + unknowns;
+}
+
+/* Returns whether the numbered tiles up to two away from ROW, COL of GRID,
+   which are around the unknowns the tile there resolves, all still fit. */
+static bool around_fits (int **grid, int row, int col)
+{
+  int i, j;
+  for (i = row - 2; i <= row + 2; i++)
+    for (j = col - 2; j <= col + 2; j++)
+      if (i >= 1 && i < nrows - 1 && j >= 1 && j < ncols - 1
+          && !tile_fits (grid, i, j))
+        return false;
+  return true;
+}
+
+/* Resolve the tile at ROW, COL, in band B's rows, if its sums say that it
+   resolves anything. The sums around the unknowns it sets are kept up to
+   date, and the numbered tiles that the change lets resolve anything are
+   queued to be checked by the band whose rows they are in. If a numbered
+   tile around them can no longer be met, the band is marked unsatisfiable
+   instead. */
+static void band_check (struct band *b, int row, int col)
+{
   int **grid = thr_data[0].bufs.grid;
-  for (i = 1; i < nrows - 1; i++)
-    for (j = 1; j < ncols - 1; j++)
-      resolved += resolve_tile (i, j, grid, -1, false);
-  return resolved;
+  int *sums = b->sums;
+  int s = sums[row * ncols + col];
+  int tile_num = grid[row][col];
+  int i, j;
+  if (!sum_resolves (tile_num, s))
+    return;
+
+  int *set[8];
+  int n = 0;
+  for (i = -1; i < 2; i++)
+    for (j = -1; j < 2; j++)
+      if (grid[row+i][col+j] == UNKNOWN)
+        set[n++] = &sums[(row + i) * ncols + col + j];
+  int delta = tile_num == SUM_MINES (s)
+    ? -SUM_UNKNOWN : SUM_MINE - SUM_UNKNOWN;
+  b->resolved += resolve_tile (row, col, grid, -1, false);
+  while (n--)
+    for (i = -1; i < 2; i++)
+      {
+        int *sum = set[n] + i * ncols;
+        sum[-1] += delta;
+        sum[0] += delta;
+        sum[1] += delta;
+      }
+  if (!around_fits (grid, row, col))
+    {
+      b->unsat = true;
+      return;
+    }
+
+  // The tiles up to two away are around the unknowns just set. Those of
+  // its rows that the first pass is yet to reach are left to it.
+  for (i = row - 2; i <= row + 2; i++)
+    {
+      if (i < 1 || i >= nrows - 1)
+        continue;
+      bool mine = b->first <= i && i < b->last;
+      for (j = col - 2; j <= col + 2; j++)
+        {
+          if (j < 1 || j >= ncols - 1 || (mine && i * ncols + j >= b->scan)
+              || !sum_resolves (grid[i][j], sums[i * ncols + j]))
+            continue;
+          if (mine)
+            band_todo (b, 0, i, j);
+          else if (i < b->first)
+            band_todo (b->above, 2, i, j);
+          else
+            band_todo (b->below, 1, i, j);
+        }
+    }
+}
+
+/* Check the tiles queued on band B, until none are left, or the band is
+   found unsatisfiable. */
+static void band_drain (struct band *b)
+{
+  int k = 0;
+  while (k < 3 && !b->unsat)
+    if (b->ntodo[k])
+      {
+        struct ind t = b->todo[k][--b->ntodo[k]];
+        band_check (b, t.row, t.col);
+        k = 0;
+      }
+    else
+      k++;
+}
+
+/* Pre-resolve band B's rows: check every tile the first time, and after,
+   only those that the bands around queued. The band may set unknowns in
+   the rows next to it, and update the sums up to two rows away, so bands
+   next to each other must not run at once. Stops once the band is found
+   unsatisfiable. */
+static void band_resolve (struct band *b)
+{
+  int **grid = thr_data[0].bufs.grid;
+  int i, j;
+  for (i = b->scan / ncols; i < b->last && !b->unsat; i++)
+    for (j = 1; j < ncols - 1 && !b->unsat; j++)
+      {
+        b->scan = i * ncols + j;
+        if (sum_resolves (grid[i][j], b->sums[b->scan]))
+          {
+            band_check (b, i, j);
+            band_drain (b);
+          }
+      }
+  b->scan = b->last * ncols;
+  band_drain (b);
+}
+
+/* Resolve tiles around ROW, COL after it changed, as band_resolve ()
+   does for the whole grid, and keep on around every tile that resolves
+   unknowns, until nothing more resolves. Returns the number of mines
+   placed, or -1 as soon as a numbered tile around the unknowns resolved
+   can no longer be met. */
+static int resolve_around (int **grid, int row, int col)
+{
+  int cap = 64;
+  struct ind *stack = (struct ind *) malloc (cap * sizeof *stack);
+  int n = 0;
+  int placed = 0;
+  int reach = 1;
+  int i, j, k;
+
+  stack[n].row = row;
+  stack[n++].col = col;
+  for (; n > 0; reach = 2)
+    {
+      // Pop a tile, and check the numbered tiles around it. Those up to two
+      // away from a tile that resolved are around its former unknowns.
+      struct ind t = stack[--n];
+      for (i = -reach; i <= reach; i++)
+        for (j = -reach; j <= reach; j++)
+          {
+            int r = t.row + i;
+            int c = t.col + j;
+            if (r < 1 || r >= nrows - 1 || c < 1 || c >= ncols - 1
+                || grid[r][c] < 0 || grid[r][c] > 8)
+              continue;
+
+            int before = 0;
+            for (k = 0; k < 9; k++)
+              before += is_mine (grid[r + k / 3 - 1][c + k % 3 - 1]);
+            if (!resolve_tile (r, c, grid, -1, false))
+              continue;
+            if (!around_fits (grid, r, c))
+              {
+                free (stack);
+                return -1;
+              }
+            for (k = 0; k < 9; k++)
+              placed += is_mine (grid[r + k / 3 - 1][c + k % 3 - 1]);
+            placed -= before;
+
+            if (n == cap)
+              {
+                cap *= 2;
+                stack = (struct ind *) realloc (stack, cap * sizeof *stack);
+              }
+            stack[n].row = r;
+            stack[n++].col = c;
+          }
+    }
+
+  free (stack);
+  return placed;
 }
 
 /* Find the unknowns in the grid, and establish the indices. */
@@ -592,315 +1914,1088 @@ static int find_unknowns (int **grid, struct ind *ind)
   return n;
 }
 
-/* Comparator function to pass to qsort (), when sorting unknown tiles. */
-int comp_tiles (const void *arg1, const void *arg2)
+/* Sum the tiles around band B's rows. */
+static void band_sums (struct band *b)
 {
-  struct sort_tile *a = (struct sort_tile *) arg1;
-  struct sort_tile *b = (struct sort_tile *) arg2;
+  int mines;
+  tile_sums (thr_data[0].bufs.grid, b->sums, NULL, &mines, b->first,
+             b->last);
+}
 
-  // Compare the NUMBER_TILES field.
-  if (a->number_tiles > b->number_tiles)
-    return -1;
-  else if (a->number_tiles < b->number_tiles)
-    return 1;
-  else
-    return 0;
+/* Mark band B unsatisfiable if a numbered tile in its rows can't have its
+   number of mines around it. The search only checks the tiles around
+   unknowns, so a grid with none left, or a tile wrong away from them,
+   would otherwise count as solved. */
+static void band_fits (struct band *b)
+{
+  int **grid = thr_data[0].bufs.grid;
+  int i, j;
+  for (i = b->first; i < b->last && !b->unsat; i++)
+    for (j = 1; j < ncols - 1 && !b->unsat; j++)
+      b->unsat = !tile_fits (grid, i, j);
 }
 
-/* Sort the unknown tiles by constraint order. The unknowns with more
-   surrounding numbered tiles will come first, and thus be searched first. */
-static void sort_unknowns (int **grid, struct ind *ind)
+/* Count the mines and unknowns in band B's rows. */
+static void band_count (struct band *b)
 {
-  struct sort_tile *unknown_tiles =
-    (struct sort_tile *) malloc (total_unknowns * sizeof *unknown_tiles);
+  b->unknowns = tile_sums (thr_data[0].bufs.grid, NULL, NULL, &b->mines,
+                           b->first, b->last);
+}
 
-  // Count the number of mines around each unknown tile.
-  int i;
-  for (i = 0; i < total_unknowns; i++)
+/* List the unknowns in band B's rows into the index, from its offset. */
+static void band_list (struct band *b)
+{
+  b->unknowns = tile_sums (thr_data[0].bufs.grid, NULL, b->ind + b->offset,
+                           &b->mines, b->first, b->last);
+}
+
+/* Key band B's unknowns by the numbered tiles around them, from the sums
+   if there are any, and count them by key. */
+static void band_keys (struct band *b)
+{
+  int **grid = thr_data[0].bufs.grid;
+  int i, j, k;
+  memset (b->pos, 0, sizeof b->pos);
+  for (i = b->offset; i < b->offset + b->unknowns; i++)
     {
-      unknown_tiles[i].index = ind[i];
+      int row = b->ind[i].row;
+      int col = b->ind[i].col;
       int number_tiles = 0;
-      int row = ind[i].row;
-      int col = ind[i].col;
-      int j, k;
-      for (j = -1; j < 2; j++)
-        for (k = -1; k < 2; k++)
-          {
-            int tile_num = grid[row+j][col+k];
-            if (0 <= tile_num && tile_num <= 8)
-              number_tiles++;
-          }
-      unknown_tiles[i].number_tiles = number_tiles;
+      if (b->sums)
+        number_tiles = SUM_NUMBERS (b->sums[row * ncols + col]);
+      else
+        for (j = -1; j < 2; j++)
+          for (k = -1; k < 2; k++)
+            {
+              int tile_num = grid[row+j][col+k];
+              if (0 <= tile_num && tile_num <= 8)
+                number_tiles++;
+            }
+      b->keys[i] = number_tiles;
+      b->pos[number_tiles]++;
     }
+}
+
+/* Move band B's unknowns to their places in the sorted index. */
+static void band_scatter (struct band *b)
+{
+  int i;
+  for (i = b->offset; i < b->offset + b->unknowns; i++)
+    b->sorted[b->pos[b->keys[i]]++] = b->ind[i];
+}
 
-  // Sort the unknown tiles.
-  qsort (unknown_tiles, total_unknowns,
-         sizeof (struct sort_tile), comp_tiles);
+/* Copy band B's share of the sorted index back to the index. */
+static void band_copy (struct band *b)
+{
+  memcpy (b->ind + b->offset, b->sorted + b->offset,
+          b->unknowns * sizeof (struct ind));
+}
 
-  // Copy sorted results back into IND.
-  for (i = 0; i < total_unknowns; i++)
-    ind[i] = unknown_tiles[i].index;
+/* Thread of band_run (). */
+static void * band_thr (void *data)
+{
+  struct band *b = (struct band *) data;
+  thread_num = b->num;
+  b->step (b);
+  return NULL;
+}
+
+/* Run STEP on every STRIDE-th band of the NBANDS at BANDS from the FIRST,
+   each on a thread of its own, but for the first, run on this one. */
+static void band_run (void (*step) (struct band *), struct band *bands,
+                      int nbands, int first, int stride)
+{
+  int i;
+  for (i = first + stride; i < nbands; i += stride)
+    {
+      bands[i].step = step;
+      pthread_create (&bands[i].thread, NULL, band_thr, &bands[i]);
+    }
+  if (first < nbands)
+    {
+      int num = thread_num;
+      thread_num = bands[first].num;
+      step (&bands[first]);
+      thread_num = num;
+    }
+  for (i = first + stride; i < nbands; i += stride)
+    pthread_join (bands[i].thread, NULL);
+}
+
+/* Sort the unknowns by constraint order. The unknowns with more
+   surrounding numbered tiles will come first, and thus be searched first.
+   Keys run from 0 to 8, so a counting sort does, and keeps unknowns with
+   the same key in row order. Each band keys and places its own unknowns. */
+static void sort_unknowns (struct band *bands, int nbands)
+{
+  struct ind *sorted =
+    (struct ind *) malloc (total_unknowns * sizeof (struct ind));
+  unsigned char *keys = (unsigned char *) malloc (total_unknowns + 1);
+  int b, k;
+  for (b = 0; b < nbands; b++)
+    {
+      bands[b].sorted = sorted;
+      bands[b].keys = keys;
+    }
+  band_run (band_keys, bands, nbands, 0, 1);
+
+  // Higher keys first, and within a key, earlier bands first.
+  int next = 0;
+  int start[10];
+  for (k = 8; k >= 0; k--)
+    {
+      start[k+1] = next;
+      for (b = 0; b < nbands; b++)
+        {
+          int n = bands[b].pos[k];
+          bands[b].pos[k] = next;
+          next += n;
+        }
+    }
+  start[0] = next;
+  band_run (band_scatter, bands, nbands, 0, 1);
+
+  // With --shuffle, deal the unknowns of each key in random order.
+  if (shuffle)
+    for (k = 8; k >= 0; k--)
+      {
+        int i;
+        for (i = start[k] - 1; i > start[k+1]; i--)
+          {
+            int j = start[k+1] + (int) (rng_double () * (i - start[k+1] + 1));
+            struct ind t = sorted[i];
+            sorted[i] = sorted[j];
+            sorted[j] = t;
+          }
+      }
+  band_run (band_copy, bands, nbands, 0, 1);
+  free (sorted);
+  free (keys);
 }
 
 /* Count the number of current existing mines on the field,
    and adjusts the MINE_TARGET field accordingly.
 
-   This function also calls a few functions that scan through the unknown
-   tiles, and these functions can be combined, but that is neglected because
-   the small time spend iterating through the grid is negligible compared to
-   the exponential time needed to solve the consistency problem. */
+   Large grids are split into bands of rows, as many as there are threads,
+   and each stage runs on every band at once. Pre-resolving, the mines, the
+   unknowns and the order of the unknowns come from passes of tile_sums ()
+   over the bands: one that sums the grid before pre-resolving, and ones
+   after that count the mines and unknowns, and list the unknowns from the
+   offsets the counts give. Pre-resolving goes on until nothing more
+   resolves. Bands next to each other take turns, as resolving a tile
+   touches the rows around it, and queue the tiles of the other that they
+   change. */
 static void preprocess_grid ()
 {
-  int **grid = thr_data[0].bufs.grid;
   struct ind *ind = thr_data[0].bufs.ind;
+  int inner = nrows - 2;
+  int nbands = max_threads;
+  int b, k;
+  if (nbands > ntiles / BAND_TILES)
+    nbands = ntiles / BAND_TILES;
+  if (nbands > inner / BAND_ROWS)
+    nbands = inner / BAND_ROWS;
+  if (nbands < 1)
+    nbands = 1;
+
+  if (!sum_code)
+    sum_select ();
+  struct band *bands = (struct band *) calloc (nbands, sizeof *bands);
+  int *sums = preresolve ? (int *) calloc (ntiles, sizeof (int)) : NULL;
+  for (b = 0; b < nbands; b++)
+    {
+      bands[b].num = b;
+      bands[b].first = 1 + (long long) inner * b / nbands;
+      bands[b].last = 1 + (long long) inner * (b + 1) / nbands;
+      bands[b].above = b ? &bands[b-1] : NULL;
+      bands[b].below = b < nbands - 1 ? &bands[b+1] : NULL;
+      bands[b].scan = bands[b].first * ncols;
+      bands[b].sums = sums;
+      bands[b].ind = ind;
+    }
 
-  // Preprocess grid, if specified.
+  // Preprocess grid, if specified. Pre-resolving stops at a numbered tile
+  // it leaves no way to meet, as there is then no solution.
   int resolved = 0;
+  bool unsat = false;
   if (preresolve)
-    resolved = preresolve_grid ();
+    {
+      band_run (band_sums, bands, nbands, 0, 1);
+      bool todo = true;
+      while (todo && !unsat)
+        {
+          band_run (band_resolve, bands, nbands, 0, 2);
+          band_run (band_resolve, bands, nbands, 1, 2);
+          todo = false;
+          for (b = 0; b < nbands; b++)
+            {
+              todo |= bands[b].ntodo[1] || bands[b].ntodo[2];
+              unsat |= bands[b].unsat;
+            }
+        }
+      for (b = 0; b < nbands; b++)
+        {
+          resolved += bands[b].resolved;
+          for (k = 0; k < 3; k++)
+            free (bands[b].todo[k]);
+        }
+    }
   if (print >= PRINT_MIN)
     printf ("Pre-resolved unknowns: %d\n", resolved);
-  if (print >= PRINT_BASIC && preresolve)
+  if (eliminate && !unsat)
+    {
+      int fixed = eliminate_grid (thr_data[0].bufs.grid, &unsat);
+      if (print >= PRINT_MIN)
+        printf ("Eliminated unknowns: %d\n", fixed);
+    }
+  if (print >= PRINT_BASIC && (preresolve || eliminate))
     board_print (thr_data[0].bufs.grid);
 
+  // Check every numbered tile, as window mode does, so that all modes
+  // agree on grids with no solution.
+  if (!unsat)
+    {
+      band_run (band_fits, bands, nbands, 0, 1);
+      for (b = 0; b < nbands; b++)
+        unsat |= bands[b].unsat;
+    }
+
+  // Find all the unknowns. Pre-resolving kept the sums up to date.
+  if (nbands > 1)
+    band_run (band_count, bands, nbands, 0, 1);
+  for (b = 1; b < nbands; b++)
+    bands[b].offset = bands[b-1].offset + bands[b-1].unknowns;
+  band_run (band_list, bands, nbands, 0, 1);
+  total_unknowns = 0;
+  int mines = 0;
+  for (b = 0; b < nbands; b++)
+    {
+      total_unknowns += bands[b].unknowns;
+      mines += bands[b].mines;
+    }
+  ind[total_unknowns].row = -1;
+  ind[total_unknowns].col = -1;
+
   // If no MINE_TARGET was set, there is no need to adjust it.
   if (mine_target > -1)
     {
-      int i, j;
-      for (i = 1; i < nrows - 1; i++)
-        for (j = 1; j < ncols - 1; j++)
-          if (is_mine (grid[i][j]))
-            mine_target--;
+      mine_target -= mines;
+
+      // With more mines placed than targeted, there is no solution. Keep
+      // the target clear of -1, which would mean no target.
+      if (mine_target < 0)
+        mine_target = -2;
     }
 
-  // Find all the unknowns.
-  total_unknowns = find_unknowns (grid, ind);
+  // Nor is there with a numbered tile that can't be met. The search only
+  // checks those around unknowns, so mark it the same way.
+  if (unsat)
+    mine_target = -2;
 
   // Sort the unknowns (by surrounding tiles) if specified.
   if (sort)
-    sort_unknowns (grid, ind);
+    sort_unknowns (bands, nbands);
+  free (sums);
+  free (bands);
 }
 
+/* Sum the 3x3 neighbourhood of every tile in rows FIRST up to LAST of
+   GRID, inside the border, into SUMS, a plane laid out as GRID's buffer,
+   as SUM_MINE, SUM_UNKNOWN and SUM_NUMBER parts, if SUMS is given. Only
+   rows with unknowns within a row of them are summed; the others are left
+   as they were, which should be zero, for no unknowns. The unknowns in the
+   rows are listed in IND in row order, as find_unknowns () does, if IND is
+   given, and the mines in them counted into MINES. Returns the number of
+   unknowns.
+   One pass streams down the rows, and the rows either side: each row is
+   coded, summed across with its neighbours, and the sums across of the
+   rows above, it and below summed down. sum_select () must have picked
+   the kernels. */
+static int tile_sums (int **grid, int *sums, struct ind *ind, int *mines,
+                      int first, int last)
+{
+  // The last three rows coded, and summed across, by row modulo 3.
+  int width = ncols - 2;
+  int *code = (int *) malloc (3 * ncols * sizeof (int));
+  int *across = (int *) malloc (3 * width * sizeof (int));
+  int *cols = (int *) malloc (ncols * sizeof (int));
+  int unknowns[3];
+  int across_row[3];
+  int n = 0;
+  int i, k;
+  *mines = 0;
 
+  for (i = first - 1; i <= last; i++)
+    {
+      // The rows either side are only coded.
+      int *row_code = code + i % 3 * ncols;
+      int outside = 0;
+      bool inside = first <= i && i < last;
+      int nrow = sum_code (grid[i], row_code, ncols, cols,
+                           inside ? mines : &outside);
+      unknowns[i % 3] = nrow;
+      across_row[i % 3] = -1;
+      if (inside)
+        {
+          if (ind)
+            for (k = 0; k < nrow; k++)
+              {
+                ind[n + k].row = i;
+                ind[n + k].col = cols[k];
+              }
+          n += nrow;
+        }
 
-/*****************************************************************************
- *
- *  Solver functions.
- *
- ****************************************************************************/
+      // Row I - 1 is now between the rows around it.
+      if (!sums || i <= first || !(unknowns[0] + unknowns[1] + unknowns[2]))
+        continue;
+      for (k = i - 2; k <= i; k++)
+        if (across_row[k % 3] != k)
+          {
+            int *c = code + k % 3 * ncols;
+            sum_add3 (c, c + 1, c + 2, across + k % 3 * width, width);
+            across_row[k % 3] = k;
+          }
+      sum_add3 (across + (i - 2) % 3 * width, across + (i - 1) % 3 * width,
+                across + i % 3 * width, sums + (i - 1) * ncols + 1, width);
+    }
 
-/* Threaded function call for solve_tree. */
-static void * solve_tree_thr (void *data)
+  free (code);
+  free (across);
+  free (cols);
+  return n;
+}
+
+/* Code the N tiles at TILES into CODE as their parts in tile sums, list
+   the unknowns among them in COLS, and add their mines to MINES. Returns
+   the number of unknowns. */
+static int sum_code_c (const int *tiles, int *code, int n, int *cols,
+                       int *mines)
 {
-  struct thr_args *args = (struct thr_args *) data;
-  thread_num = args->thread_num;
-  int tmp = args->thread_num;
-  struct buffers bufs = thr_data[thread_num].bufs;
+  int i, k = 0;
+  for (i = 0; i < n; i++)
+    {
+      int t = tiles[i];
+      bool unknown = t == UNKNOWN;
+      code[i] = is_mine (t) * SUM_MINE + unknown * SUM_UNKNOWN
+        + (0 <= t && t <= 8) * SUM_NUMBER;
+      *mines += is_mine (t);
+      if (unknown)
+        cols[k++] = i;
+    }
+  return k;
+}
 
-  int num_goals = solve_tree (args->unknown_num, args->mine_count, bufs);
+/* Set OUT to the sums of A, B and C, N ints each. */
+static void sum_add3_c (const int *a, const int *b, const int *c, int *out,
+                        int n)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    out[i] = a[i] + b[i] + c[i];
+}
 
-  // Critical section.
-  // 1) Update goals found.
-  // 2) Mark thread as available.
-  // 3) Check for end of execution.
-  bool signal = false;
-  LOCK;
-  goal_states += num_goals;
-  thr_data[tmp].avail = true;
-  avail_threads++;
-  if (avail_threads == max_threads || (single && num_goals))
-    pthread_cond_signal (thr_cond);
-  UNLOCK;
+#if defined (__x86_64__) || defined (__i386__)
+/* sum_code_c (), 4 tiles at a time. A compare sets all bits of the lanes
+   it holds in, so subtracting it counts them, and the unknowns are read
+   off the sign bits. */
+__attribute__ ((target ("sse2")))
+static int sum_code_sse2 (const int *tiles, int *code, int n, int *cols,
+                          int *mines)
+{
+  __m128i count = _mm_setzero_si128 ();
+  int lanes[4];
+  int i, k = 0;
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128i t = _mm_loadu_si128 ((const __m128i *) (tiles + i));
+      __m128i m = _mm_cmpgt_epi32 (t, _mm_set1_epi32 (MINE_ON - 1));
+      __m128i u = _mm_cmpeq_epi32 (t, _mm_set1_epi32 (UNKNOWN));
+      __m128i d = _mm_and_si128 (_mm_cmpgt_epi32 (t, _mm_set1_epi32 (-1)),
+                                 _mm_cmplt_epi32 (t, _mm_set1_epi32 (9)));
+      __m128i c = _mm_or_si128 (_mm_and_si128 (m, _mm_set1_epi32 (SUM_MINE)),
+                                _mm_and_si128 (u,
+                                               _mm_set1_epi32 (SUM_UNKNOWN)));
+      c = _mm_or_si128 (c, _mm_and_si128 (d, _mm_set1_epi32 (SUM_NUMBER)));
+      _mm_storeu_si128 ((__m128i *) (code + i), c);
+      count = _mm_sub_epi32 (count, m);
+      int mask = _mm_movemask_ps (_mm_castsi128_ps (u));
+      for (; mask; mask &= mask - 1)
+        cols[k++] = i + __builtin_ctz (mask);
+    }
 
-  return NULL;
+  _mm_storeu_si128 ((__m128i *) lanes, count);
+  *mines += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  int tail = sum_code_c (tiles + i, code + i, n - i, cols + k, mines);
+  for (; tail; tail--, k++)
+    cols[k] += i;
+  return k;
 }
 
-/* Solve the game board with brute force algorithm. The algorithm takes a trial
-   and error approach, placing one mine at a time. Backtracking and pruning of
-   the search tree are employed when an inconsistent game board is encountered.
-   This algorithm is based on Neville Mehta's, ported from Lisp to C++ by
-   Meredith Kadlac, but is much more optimized and performs more than 20x
-   faster. */
-static int solve_tree (int unknown_num, int mine_count, struct buffers bufs)
+/* sum_add3_c (), 4 ints at a time. */
+__attribute__ ((target ("sse2")))
+static void sum_add3_sse2 (const int *a, const int *b, const int *c,
+                           int *out, int n)
 {
-  int num_goals = 0;
-  int row = bufs.ind[unknown_num].row;
-  int col = bufs.ind[unknown_num].col;
-
-  if (mine_src (bufs.grid[row][col]) >= 0)
-    {
-      // Unknown was pre-assigned. Just move on to next unknown if consistent.
-      if (!consistency_check (bufs.ind[unknown_num], bufs.grid, unknown_num, false))
-        return 0;
-      if (is_mine (bufs.grid[row][col]))
-        mine_count++;
-      if (unknown_num == total_unknowns - 1
-          && (mine_target == -1 || mine_count == mine_target))
-        {
-          num_goals++;
-          if (diag)
-            diag_print (bufs.ind, bufs.grid);
-          if (print >= PRINT_ALL)
-            board_print (bufs.grid);
-        }
-      else if (unknown_num < total_unknowns - 1)
-        num_goals = solve_tree (unknown_num+1, mine_count, bufs);
-    }
-  else if (mine_count == mine_target)
+  int i;
+  for (i = 0; i + 4 <= n; i += 4)
     {
-      // All mines are used up, just check the MINE_OFF subtree. Do not thread.
-      bufs.grid[row][col] = force_off (unknown_num);
-      num_goals = solve_subtree (unknown_num, mine_count, bufs, false);
+      __m128i s = _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (a + i)),
+                                 _mm_loadu_si128 ((const __m128i *) (b + i)));
+      s = _mm_add_epi32 (s, _mm_loadu_si128 ((const __m128i *) (c + i)));
+      _mm_storeu_si128 ((__m128i *) (out + i), s);
     }
-  else if ((mine_target - mine_count) == (total_unknowns - unknown_num - 1))
+  sum_add3_c (a + i, b + i, c + i, out + i, n - i);
+}
+
+/* sum_code_c (), 8 tiles at a time. */
+__attribute__ ((target ("avx2")))
+static int sum_code_avx2 (const int *tiles, int *code, int n, int *cols,
+                          int *mines)
+{
+  __m256i count = _mm256_setzero_si256 ();
+  int lanes[8];
+  int i, k = 0;
+  for (i = 0; i + 8 <= n; i += 8)
     {
-      // To be a solution, all remaining mines must be on. Just check the
-      // MINE_ON subtree. Do not thread.
-      bufs.grid[row][col] = force_on (unknown_num);
-      num_goals = solve_subtree (unknown_num, mine_count + 1, bufs, false);
+      __m256i t = _mm256_loadu_si256 ((const __m256i *) (tiles + i));
+      __m256i m = _mm256_cmpgt_epi32 (t, _mm256_set1_epi32 (MINE_ON - 1));
+      __m256i u = _mm256_cmpeq_epi32 (t, _mm256_set1_epi32 (UNKNOWN));
+      __m256i d = _mm256_and_si256 (_mm256_cmpgt_epi32
+                                    (t, _mm256_set1_epi32 (-1)),
+                                    _mm256_cmpgt_epi32
+                                    (_mm256_set1_epi32 (9), t));
+      __m256i c = _mm256_or_si256
+        (_mm256_and_si256 (m, _mm256_set1_epi32 (SUM_MINE)),
+         _mm256_and_si256 (u, _mm256_set1_epi32 (SUM_UNKNOWN)));
+      c = _mm256_or_si256 (c, _mm256_and_si256
+                           (d, _mm256_set1_epi32 (SUM_NUMBER)));
+      _mm256_storeu_si256 ((__m256i *) (code + i), c);
+      count = _mm256_sub_epi32 (count, m);
+      int mask = _mm256_movemask_ps (_mm256_castsi256_ps (u));
+      for (; mask; mask &= mask - 1)
+        cols[k++] = i + __builtin_ctz (mask);
     }
-  else if (mine_target == -1 || mine_count < mine_target)
-    {
-      // Check both subtrees. For the first subtree, instruct it to spin off a
-      // thread if a thread is available.
-
-      // Determine which subtree to check first.
-      bool mine_on = false;
-
-      // Check the first subtree. Thread if possible.
-      if (mine_on)
-        {
-          if (print >= PRINT_DEBUG)
-            fprintf (stderr, "[%d][%d] on\n", row, col);
-          bufs.grid[row][col] = force_on (unknown_num);
-          mine_count++;
-        }
-      else
-        {
-          if (print >= PRINT_DEBUG)
-            fprintf (stderr, "[%d][%d] off\n", row, col);
-          bufs.grid[row][col] = force_off (unknown_num);
-        }
-      num_goals = solve_subtree (unknown_num, mine_count, bufs, true);
 
-      // If only a single solution is desired, and it's been found,
-      // then we're done.
-      if (single && num_goals)
-        return num_goals;
+  _mm256_storeu_si256 ((__m256i *) lanes, count);
+  int j;
+  for (j = 0; j < 8; j++)
+    *mines += lanes[j];
+  int tail = sum_code_c (tiles + i, code + i, n - i, cols + k, mines);
+  for (; tail; tail--, k++)
+    cols[k] += i;
+  return k;
+}
 
-      // Check the other subtree. Do not thread.
-      mine_on = !mine_on;
-      if (mine_on)
-        {
-          if (print >= PRINT_DEBUG)
-            fprintf (stderr, "[%d][%d] on\n", row, col);
-          bufs.grid[row][col] = force_on (unknown_num);
-          mine_count++;
-        }
-      else
-        {
-          if (print >= PRINT_DEBUG)
-            fprintf (stderr, "[%d][%d] off\n", row, col);
-          bufs.grid[row][col] = force_off (unknown_num);
-        }
-      clear_unknowns (unknown_num, bufs.ind, bufs.grid);
-      num_goals += solve_subtree (unknown_num, mine_count, bufs, false);
+/* sum_add3_c (), 8 ints at a time. */
+__attribute__ ((target ("avx2")))
+static void sum_add3_avx2 (const int *a, const int *b, const int *c,
+                           int *out, int n)
+{
+  int i;
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256i s = _mm256_add_epi32
+        (_mm256_loadu_si256 ((const __m256i *) (a + i)),
+         _mm256_loadu_si256 ((const __m256i *) (b + i)));
+      s = _mm256_add_epi32 (s, _mm256_loadu_si256
+                            ((const __m256i *) (c + i)));
+      _mm256_storeu_si256 ((__m256i *) (out + i), s);
     }
-  return num_goals;
+  sum_add3_c (a + i, b + i, c + i, out + i, n - i);
 }
+#endif
 
-/* */
-static int solve_subtree (int unknown_num, int mine_count, struct buffers bufs,
-                          bool create_thread)
+/* Pick the widest tile sum kernels the CPU runs, as CPUID tells. */
+static void sum_select ()
 {
-  int num_goals = 0;
-  int row = bufs.ind[unknown_num].row;
-  int col = bufs.ind[unknown_num].col;
-
-  bool consis = consistency_check (bufs.ind[unknown_num], bufs.grid,
-                                   unknown_num, true);
-  if (consis)
-    {
-      // The mine state is valid. Check for subtrees, or if this branch of
-      // the search tree is exhausted.
-      if (unknown_num < total_unknowns - 1
-          && (mine_target == -1 || mine_count <= mine_target))
-        {
-          // A subtree exists:
-          // 1) Not all unknowns are assigned.
-          // 2) If MINE_TARGET is specified, it has not been exceeded.
-
-          // Check if we should create a new thread.
-          if (create_thread
-              && (mine_target == -1 || mine_count < mine_target)
-              && (total_unknowns - unknown_num > 10))
-            {
-              LOCK;
-              if (avail_threads <= 0)
-                {
-                  UNLOCK;
-                  create_thread = false;
-                }
-              else
-                {
-                  // Find a thread and claim it.
-                  int new_thr = thread_find (0);
-                  thr_data[new_thr].avail = false;
-                  avail_threads--;
-                  UNLOCK;
-
-                  // Copy buffers into new thread.
-                  thread_copy (new_thr, thread_num);
-                  struct thr_args *args =
-                    (struct thr_args *) malloc (sizeof *args);
-                  args->thread_num = new_thr;
-                  args->unknown_num = unknown_num + 1;
-                  args->mine_count = mine_count;
-                  pthread_create (&thr_data[new_thr].thread, NULL,
-                                  solve_tree_thr, args);
-                  pthread_detach (thr_data[new_thr].thread);
-                }
-            }
-          else
-            {
-              create_thread = false;
-            }
-          if (!create_thread)
-            {
-              //fprintf (stderr, "Rec call\n");
-              num_goals = solve_tree (unknown_num + 1, mine_count, bufs);
-            }
-        }
-      else if (unknown_num == total_unknowns - 1
-               && (mine_target == -1 || mine_count == mine_target))
-        {
-          // Solution has been found:
-          // 1) All unknowns have been assigned a valid state.
-          // 2) MINE_TARGET, if specified, has been matched.
-          num_goals++;
-          if (diag)
-            diag_print (bufs.ind, bufs.grid);
-          if (print >= PRINT_ALL)
-            board_print (bufs.grid);
-        }
-      else
-        {
-          // The remaining case is that all unknown tiles have been assigned,
-          // and MINE_TARGET was specified but not reached. Here, there is
-          // nothing to be done.
-        }
+  sum_code = sum_code_c;
+  sum_add3 = sum_add3_c;
+#if defined (__x86_64__) || defined (__i386__)
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      sum_code = sum_code_avx2;
+      sum_add3 = sum_add3_avx2;
     }
-  else
+  else if (__builtin_cpu_supports ("sse2"))
     {
-      //fprintf (stderr, "[%d][%d] consis failed\n", row, col);
-      //board_print (bufs.grid);
-
+      sum_code = sum_code_sse2;
+      sum_add3 = sum_add3_sse2;
     }
-  return num_goals;
+#endif
 }
 
-/*
-   This function only checks the tiles around the mine that was most recently
+
+
+/*****************************************************************************
+ *
+ *  Solver functions.
+ *
+ ****************************************************************************/
+
+/* Attempt to find a solution, or multiple solutions. With --resume, search
+   the subtrees the checkpoint left open one by one, and otherwise the whole
+   tree. With PROGRESS_SECS or CKPT_FILE, a thread of its own reports
+   progress or asks for checkpoints meanwhile. */
+static void search ()
+{
+  int i;
+  atomic_store (&search_stop, false);
+  atomic_store (&budget_out, false);
+  atomic_store (&ckpt_wanted, false);
+  memset (&progress, 0, sizeof progress);
+  ticking = node_budget >= 0 || time_budget >= 0 || progress_secs > 0
+    || ckpt_file;
+  tree_select ();
+
+  // Threads take on subtrees by replaying the path to them on grids of
+  // their own, which differ from thread 0's only in the unknowns. Their
+  // search stacks hold at most one frame per unknown, and trails one entry
+  // per unknown, and as many again while probing a sibling.
+  for (i = 0; i < max_threads; i++)
+    {
+      if (i)
+        memcpy (thr_data[i].bufs.buf, thr_data[0].bufs.buf,
+                ntiles * sizeof (int));
+      thr_data[i].stack = (struct frame *)
+        malloc ((total_unknowns + 1) * sizeof (struct frame));
+      thr_data[i].trail = (int **)
+        malloc (2 * (total_unknowns + 1) * sizeof (int *));
+      thr_data[i].saved = (int *) malloc ((total_unknowns + 1) * sizeof (int));
+    }
+
+  if (ckpt_file || resume_file)
+    ckpt_setup ();
+  if (resume_file)
+    {
+      ckpt_load ();
+      goal_states += ckpt_goals;
+      progress.goals = ckpt_goals;
+      progress.explored = ckpt_done;
+    }
+
+  pthread_t monitor;
+  if (progress_secs > 0 || ckpt_file)
+    {
+      monitor_done = false;
+      pthread_create (&monitor, NULL, monitor_thr, NULL);
+    }
+
+  if (!resume_file)
+    search_run (0, 0, 1);
+  else
+    {
+      // No search thread runs between the subtrees, so they only need the
+      // lock to keep checkpoints from seeing RESUME_NEXT half updated.
+      while (resume_next < resume_open.n
+             && !atomic_load (&search_stop))
+        {
+          struct prefix *p = &resume_open.p[resume_next];
+          int mine_count;
+          double weight = ldexp (1, -p->halves);
+          LOCK;
+          resume_next++;
+          UNLOCK;
+          if (!prefix_replay (thr_data[0].bufs, p, &mine_count))
+            thr_stats[0].explored += weight;
+          else if (p->len < total_unknowns)
+            search_run (p->len, mine_count, weight);
+          else
+            {
+              // A whole assignment.
+              if ((mine_target == -1 || mine_count == mine_target)
+                  && goal_claim ())
+                {
+                  goal_states++;
+                  if (diag)
+                    diag_print (thr_data[0].bufs.ind, thr_data[0].bufs.grid);
+                  if (print >= PRINT_ALL)
+                    board_print (thr_data[0].bufs.grid);
+                }
+              thr_stats[0].explored += weight;
+            }
+          LOCK;
+          progress_publish (&thr_stats[0]);
+          UNLOCK;
+        }
+    }
+
+  if (progress_secs > 0 || ckpt_file)
+    {
+      pthread_mutex_lock (&monitor_lock);
+      monitor_done = true;
+      pthread_cond_signal (&monitor_cond);
+      pthread_mutex_unlock (&monitor_lock);
+      pthread_join (monitor, NULL);
+    }
+
+  // A search that ran to the end leaves nothing open. One stopped by a
+  // budget wrote its last checkpoint as it stopped.
+  if (ckpt_file && !atomic_load (&budget_out))
+    {
+      resume_next = resume_open.n;
+      ckpt_write (ckpt_file, &ckpt_open);
+    }
+  if (ckpt_file || resume_file)
+    {
+      free (ckpt_grid);
+      free (ckpt_root.bits);
+    }
+  for (i = 0; i < max_threads; i++)
+    {
+      free (thr_data[i].stack);
+      free (thr_data[i].trail);
+      free (thr_data[i].saved);
+    }
+  for (i = 0; i < resume_open.n; i++)
+    free (resume_open.p[i].bits);
+  free (resume_open.p);
+  memset (&resume_open, 0, sizeof resume_open);
+  resume_next = 0;
+}
+
+/* Search the subtree under UNKNOWN_NUM, on thread 0's grid, with
+   MINE_COUNT mines before it and WEIGHT of the tree under it: spin off the
+   search in thread 0, wait for every thread it splits off to finish, and
+   join them. When a single solution is wanted, the first one found stops
+   the others. */
+static void search_run (int unknown_num, int mine_count, double weight)
+{
+  struct thr_args *args = (struct thr_args *) malloc (sizeof *args);
+  args->thread_num = 0;
+  args->unknown_num = unknown_num;
+  args->mine_count = mine_count;
+  args->weight = weight;
+  args->est = -1;
+  args->prefix.bits = NULL;
+  LOCK;
+
+  // Parsing the grid claims thread 0, and the subtree before this one gave
+  // it up.
+  if (thr_data[0].avail)
+    {
+      thr_data[0].avail = false;
+      avail_threads--;
+      thr_stats[0].idle_ms += now_ms () - thr_stats[0].idle_since;
+    }
+  pthread_create (&thr_data[0].thread, NULL, solve_tree_thr, args);
+  thr_data[0].running = true;
+  while (avail_threads < max_threads)
+    pthread_cond_wait (thr_cond, thr_lock);
+  UNLOCK;
+
+  int i;
+  for (i = 0; i < max_threads; i++)
+    if (thr_data[i].running)
+      {
+        pthread_join (thr_data[i].thread, NULL);
+        thr_data[i].running = false;
+      }
+}
+
+/* Probe down the subtree under unknown FIRST of GRID, with MINE_COUNT
+   mines before it, as Knuth did. A probe follows the search order and
+   forcing of solve_tree (): where the search would try both states of an
+   unknown, it tries both, and goes on down one of the consistent ones at
+   random, drawn from RNG. The nodes it tries, each weighed by the product
+   of the consistent branches above it, are an unbiased estimate of the
+   nodes in the subtree; returns that, or as soon as it reaches LIMIT, what
+   it has so far. Adds the nodes tried to TRIED. The unknowns the subtree
+   assigns are left unknown again, by the trail, which the thread must
+   keep. */
+static double tree_probe (int **grid, struct ind *ind, int first,
+                          int mine_count, double limit, uint64_t *rng,
+                          long long *tried)
+{
+  // Forcing counts itself in the statistics.
+  long long forced = thr_stats[thread_num].forced;
+  int start = trail_len;
+  double weight = 1;
+  double est = 0;
+  int u;
+  for (u = first; u < total_unknowns && est < limit; u++)
+    {
+      int *tile = &grid[ind[u].row][ind[u].col];
+      if (mine_src (*tile) >= 0)
+        {
+          // Pre-assigned.
+          est += weight;
+          (*tried)++;
+          if (!consistency_check (ind[u], grid, u, false))
+            break;
+          mine_count += is_mine (*tile);
+          continue;
+        }
+
+      bool ok[2] = {false, false};
+      int x;
+      if (mine_count == mine_target)
+        ok[0] = true;
+      else if (mine_target - mine_count == total_unknowns - u)
+        ok[1] = true;
+      else if (mine_target == -1 || mine_count < mine_target)
+        ok[0] = ok[1] = true;
+      else
+        break;
+
+      // Try each state the search would, forcing as it would.
+      trail_push (tile);
+      int mark = trail_len;
+      for (x = 0; x < 2; x++)
+        if (ok[x])
+          {
+            est += weight;
+            (*tried)++;
+            trail_undo (mark);
+            *tile = x ? force_on (u) : force_off (u);
+            ok[x] = consistency_check (ind[u], grid, u, true);
+          }
+      if (!ok[0] && !ok[1])
+        break;
+
+      // Go on down a consistent state, redoing its forcing if the other
+      // state was tried since.
+      if (ok[0] && ok[1])
+        {
+          weight *= 2;
+          x = rng_uniform (rng) < 0.5;
+        }
+      else
+        x = ok[1];
+      if (!x && *tile != force_off (u))
+        {
+          trail_undo (mark);
+          *tile = force_off (u);
+          consistency_check (ind[u], grid, u, true);
+        }
+      mine_count += x;
+    }
+
+  trail_undo (start);
+  thr_stats[thread_num].forced = forced;
+  return est;
+}
+
+/* Estimate the size of the search tree with N random probes down it, as
+   tree_probe () makes them. The tree is the subtree under unknown FIRST of
+   thread 0's grid, with MINE_COUNT mines before it. Sets NODES to the mean
+   estimate, ERR to its standard error, and MS to the time the search would
+   take on one thread, at the probes' speed per node. */
+static void tree_estimate (int first, int mine_count, int n, double *nodes,
+                           double *err, double *ms)
+{
+  struct ind *ind = thr_data[0].bufs.ind;
+  int *buf = (int *) malloc (ntiles * sizeof (int));
+  int **grid = (int **) malloc (nrows * sizeof (int *));
+  int i, p;
+  memcpy (buf, thr_data[0].bufs.buf, ntiles * sizeof (int));
+  for (i = 0; i < nrows; i++)
+    grid[i] = buf + i * ncols;
+  trail = (int **) malloc ((total_unknowns + 1) * sizeof (int *));
+  trail_len = 0;
+
+  double sum = 0;
+  double sum_sq = 0;
+  long long tried = 0;
+  double start = now_ms ();
+  for (p = 0; p < n; p++)
+    {
+      double est = tree_probe (grid, ind, first, mine_count, INFINITY,
+                               &rng_state, &tried);
+      sum += est;
+      sum_sq += est * est;
+    }
+
+  double time = now_ms () - start;
+  free (trail);
+  trail = NULL;
+  free (grid);
+  free (buf);
+
+  *nodes = sum / n;
+  *err = n > 1 ? sqrt ((sum_sq / n - *nodes * *nodes) / (n - 1)) : 0;
+  *ms = tried ? *nodes * time / tried : 0;
+}
+
+/* Estimate the search tree with PROBES probes if asked to, and print the
+   estimate. When only the number of solutions is wanted, a decision
+   diagram counts them in time that follows the width of the board's
+   constraints rather than their number, and seldom has as many nodes as
+   the search tree, so with a big enough tree, count them that way instead,
+   and print the count. The estimate is low for trees whose dead ends show
+   late, which probes rarely get deep enough into, so the bar is low.
+   Returns true if they were counted, and there is nothing to search. */
+static bool plan_search ()
+{
+  // A tree of fewer unknowns can't reach ENGINE_NODES. Auto mode may have
+  // picked the diagram already.
+  bool counting = count_only ();
+  int n = probes;
+  if (!n && counting && !count_dd && ldexp (2, total_unknowns) > ENGINE_NODES)
+    n = ENGINE_PROBES;
+
+  double nodes = 0, err, ms;
+  if (n)
+    tree_estimate (0, 0, n, &nodes, &err, &ms);
+  if (probes && print >= PRINT_MIN)
+    printf ("Estimated search tree: %.4g nodes (standard error %.2g), "
+            "%.4g ms on one thread\n", nodes, err, ms);
+  if (!counting || (nodes < ENGINE_NODES && !count_dd))
+    return false;
+
+  long double count = dd_goal_count (thr_data[0].bufs.grid);
+  if (count < 0)
+    return false;
+  goal_states = count < INT_MAX ? (int) count : INT_MAX;
+  if (print >= PRINT_MIN)
+    printf ("Counted by decision diagram instead of searching.\n");
+  if (print >= PRINT_BASIC)
+    printf ("Number of goal states: %.0Lf\n", count);
+  return true;
+}
+
+/* Whether only the number of solutions is wanted, so that they may be
+   counted without searching. A checkpoint asked for needs the search. */
+static bool count_only ()
+{
+  return !single && print < PRINT_ALL && !diag && !stats && node_budget < 0
+    && time_budget < 0 && !resume_file && !ckpt_file;
+}
+
+/* Threaded function call for solve_tree. */
+static void * solve_tree_thr (void *data)
+{
+  struct thr_args *args = (struct thr_args *) data;
+  thread_num = args->thread_num;
+  int tmp = args->thread_num;
+  struct buffers bufs = thr_data[thread_num].bufs;
+  tree_weight = args->weight;
+  split_recheck = 0;
+  split_rng = (thr_stats[tmp].nodes + 1) * 0x9e3779b97f4a7c15ULL + tmp;
+
+  // A subtree split off is the on state of an unknown, on the path the
+  // other thread took to it. The splitting thread found that consistent.
+  bool sibling = args->prefix.bits != NULL;
+  if (sibling)
+    {
+      int mine_count;
+      prefix_replay (bufs, &args->prefix, &mine_count);
+      free (args->prefix.bits);
+    }
+
+  TRACE (TRACE_STEAL, args->unknown_num, 0, 0);
+  long long nodes = thr_stats[tmp].nodes;
+  int num_goals = solve_tree (args->unknown_num, args->mine_count, sibling);
+  TRACE (TRACE_DONE, args->unknown_num, 0, num_goals);
+
+  // Measure what a split subtree cost against its estimate.
+  if (args->est >= 0)
+    {
+      nodes = thr_stats[tmp].nodes - nodes;
+      int bucket = nodes > 1 ? (int) log2 ((double) nodes) : 0;
+      thr_stats[tmp].split_size[bucket < STATS_BUCKETS ? bucket
+                                : STATS_BUCKETS - 1]++;
+      thr_stats[tmp].split_err += fabs (log2 (args->est > 1 ? args->est : 1)
+                                        - log2 (nodes > 1 ? nodes : 1));
+    }
+  free (args);
+
+  // Critical section.
+  // 1) Update goals found.
+  // 2) Mark thread as available.
+  // 3) Check for end of execution.
+  bool signal = false;
+  LOCK;
+  goal_states += num_goals;
+  progress_publish (&thr_stats[tmp]);
+  thr_data[tmp].avail = true;
+  thr_stats[tmp].idle_since = now_ms ();
+  avail_threads++;
+  if (avail_threads == max_threads)
+    pthread_cond_signal (thr_cond);
+  ckpt_ready ();
+  UNLOCK;
+
+  return NULL;
+}
+
+/* Solve the game board with brute force algorithm. The algorithm takes a trial
+   and error approach, placing one mine at a time. Backtracking and pruning of
+   the search tree are employed when an inconsistent game board is encountered.
+   This algorithm is based on Neville Mehta's, ported from Lisp to C++ by
+   Meredith Kadlac, but is much more optimized and performs more than 20x
+   faster.
+   Searches the subtree under UNKNOWN_NUM, with MINE_COUNT mines before it,
+   on this thread's grid, or with SIBLING, only the on state of UNKNOWN_NUM,
+   split off by another thread. The search goes down and back up an explicit
+   stack of the unknowns it tries both states of, rather than recursing, so
+   that any number of unknowns fits in the thread's stack. Going back up
+   undoes the trail of tiles assigned since, rather than scanning the
+   unknowns after. Returns the goal states found.
+   It is built from ms_tree.h once for each combination of the options it
+   checks on every node, as solve_tree_N (), and SOLVE_TREE points to the
+   one for the options. */
+#define TREE_VARIANT 0
+#include "ms_tree.h"
+#define TREE_VARIANT 1
+#include "ms_tree.h"
+#define TREE_VARIANT 2
+#include "ms_tree.h"
+#define TREE_VARIANT 3
+#include "ms_tree.h"
+#define TREE_VARIANT 4
+#include "ms_tree.h"
+#define TREE_VARIANT 5
+#include "ms_tree.h"
+#define TREE_VARIANT 6
+#include "ms_tree.h"
+#define TREE_VARIANT 7
+#include "ms_tree.h"
+#define TREE_VARIANT 8
+#include "ms_tree.h"
+#define TREE_VARIANT 9
+#include "ms_tree.h"
+#define TREE_VARIANT 10
+#include "ms_tree.h"
+#define TREE_VARIANT 11
+#include "ms_tree.h"
+#define TREE_VARIANT 12
+#include "ms_tree.h"
+#define TREE_VARIANT 13
+#include "ms_tree.h"
+#define TREE_VARIANT 14
+#include "ms_tree.h"
+#define TREE_VARIANT 15
+#include "ms_tree.h"
+
+static int (*const tree_variants[]) (int, int, bool) = {
+  solve_tree_0, solve_tree_1, solve_tree_2, solve_tree_3, solve_tree_4,
+  solve_tree_5, solve_tree_6, solve_tree_7, solve_tree_8, solve_tree_9,
+  solve_tree_10, solve_tree_11, solve_tree_12, solve_tree_13, solve_tree_14,
+  solve_tree_15
+};
+
+/* Point SOLVE_TREE to the variant of the search for the options. */
+static void tree_select ()
+{
+  solve_tree = tree_variants[single | (mine_target != -1) << 1 | force << 2
+                             | (print >= PRINT_ALL || diag) << 3];
+}
+
+/* Hand the on state of the first unknown on this thread's decision stack
+   STACK whose on state is still to be searched to an idle thread. It is
+   the biggest subtree the thread has left, as far as it knows. It is only
+   handed off if a probe down it estimates it worth it, the fewer nodes the
+   more threads are idle. Frames below BOTTOM have no such state left, or
+   were found too small; it is moved up past them. */
+static void split_bottom (struct frame *stack, int *bottom)
+{
+  while (*bottom < stack_len && stack[*bottom].state != FRAME_OFF)
+    (*bottom)++;
+  if (*bottom == stack_len)
+    return;
+  struct frame *f = &stack[*bottom];
+  struct buffers bufs = thr_data[thread_num].bufs;
+
+  // The one after a subtree found too small is probed once the thread has
+  // searched as many nodes again, so that probes take a bounded share of
+  // its time.
+  int idle = atomic_load_explicit (&avail_threads, memory_order_relaxed);
+  double est = sibling_probe (f);
+  if (est < split_nodes / idle)
+    {
+      thr_stats[thread_num].declined++;
+      split_recheck = thr_stats[thread_num].nodes + split_nodes;
+      (*bottom)++;
+      return;
+    }
+
+  double start = now_ms ();
+  LOCK;
+  if (avail_threads <= 0)
+    {
+      UNLOCK;
+      return;
+    }
+
+  // Find a thread and claim it.
+  int new_thr = thread_find (0);
+  thr_data[new_thr].avail = false;
+  avail_threads--;
+  UNLOCK;
+
+  // The new thread's slot isn't running yet, so its statistics are safe
+  // to update from here.
+  thr_stats[thread_num].splits++;
+  TRACE (TRACE_SPLIT, f->unknown, 1, new_thr);
+  thr_stats[new_thr].steals++;
+  thr_stats[new_thr].idle_ms += now_ms () - thr_stats[new_thr].idle_since;
+
+  // The slot's last thread is done with it, but may not have returned yet.
+  if (thr_data[new_thr].running)
+    pthread_join (thr_data[new_thr].thread, NULL);
+
+  // Hand it the path down to the unknown, to replay on its own grid. The
+  // unknowns before it are as they were when it was reached.
+  struct thr_args *args = (struct thr_args *) malloc (sizeof *args);
+  args->thread_num = new_thr;
+  args->unknown_num = f->unknown;
+  args->mine_count = f->mine_count;
+  args->weight = f->weight / 2;
+  args->est = est;
+  prefix_make (&args->prefix, bufs.grid, bufs.ind, f->unknown, false, 0);
+
+  // Its subtree is no longer this thread's to search, nor to check in.
+  f->state = FRAME_GIVEN;
+
+  // Start it under the lock, which it needs to give up its slot, so that
+  // the slot can't be claimed again before the thread is recorded.
+  LOCK;
+  pthread_create (&thr_data[new_thr].thread, NULL, solve_tree_thr, args);
+  thr_data[new_thr].running = true;
+  UNLOCK;
+  thr_stats[thread_num].split_ms += now_ms () - start;
+}
+
+/* Estimate the nodes under the on state of the unknown of frame F, with
+   one probe as tree_probe () makes them, from the grid as it would be
+   there. The tiles the search assigned since F's off state are set aside
+   meanwhile, and put back after. They stay on the trail, so the probe
+   adds its own after them. */
+static double sibling_probe (struct frame *f)
+{
+  struct buffers bufs = thr_data[thread_num].bufs;
+  int *saved = thr_data[thread_num].saved;
+  int end = trail_len;
+  int i;
+  for (i = f->mark; i < end; i++)
+    {
+      saved[i - f->mark] = *trail[i];
+      *trail[i] = UNKNOWN;
+    }
+
+  // Forcing counts itself in the statistics.
+  long long forced = thr_stats[thread_num].forced;
+  long long tried = 0;
+  int u = f->unknown;
+  int *tile = &bufs.grid[bufs.ind[u].row][bufs.ind[u].col];
+  double est = 1;
+  *tile = force_on (u);
+  if (consistency_check (bufs.ind[u], bufs.grid, u, true))
+    est += tree_probe (bufs.grid, bufs.ind, u + 1, f->mine_count + 1,
+                       INFINITY, &split_rng, &tried);
+  trail_undo (end);
+  thr_stats[thread_num].forced = forced;
+
+  *tile = force_off (u);
+  for (i = f->mark; i < end; i++)
+    *trail[i] = saved[i - f->mark];
+  return est;
+}
+
+/*
+   This function only checks the tiles around the mine that was most recently
    turned on/off, since the validity of other tiles would not be affected.
 
    Given:
@@ -981,52 +3076,3689 @@ static inline void clear_unknowns (int i, struct ind *ind, int **grid)
       while (i < total_unknowns)
         grid[ind[i].row][ind[i++].col] = UNKNOWN;
     }
-  else
+  else
+    {
+      while (i < total_unknowns)
+        {
+          int src = mine_src (grid[ind[i].row][ind[i].col]);
+          if (src >= init)
+            {
+              grid[ind[i].row][ind[i].col] = UNKNOWN;
+            }
+          i++;
+        }
+    }
+}
+
+/* Record TILE, about to be assigned, on this thread's trail, if it keeps
+   one. */
+static inline void trail_push (int *tile)
+{
+  if (trail)
+    trail[trail_len++] = tile;
+}
+
+/* Set the tiles on the trail after the first MARK back to unknown. */
+static inline void trail_undo (int mark)
+{
+  while (trail_len > mark)
+    *trail[--trail_len] = UNKNOWN;
+}
+
+/* When an unknown is forced on/off, use this function to set the value.
+   Later, we can determine which unknown forced this unknown to turn on/off. */
+static inline int force_on (int unknown_num)
+{
+  return unknown_num + MINE_ON + 1;
+}
+static inline int force_off (int unknown_num)
+{
+  return -force_on (unknown_num);
+}
+
+/* Check if a mapped tile value denotes if the mine is on. False is returned
+   otherwise. This function is not meant to be used when the tile being checked
+   is not a mine. */
+static inline bool is_mine (int tile_val)
+{
+  return (tile_val >= MINE_ON);
+}
+
+/* Count an assignment tried at DEPTH in this thread's statistics. */
+static inline void stats_node (int depth)
+{
+  struct stats *st = &thr_stats[thread_num];
+  st->nodes++;
+  st->depth[(long long) depth * STATS_BUCKETS / total_unknowns]++;
+  if (depth >= st->max_depth)
+    st->max_depth = depth + 1;
+  if (!(st->nodes & (TICK_NODES - 1)) && ticking)
+    search_tick (depth);
+}
+
+/* Count the subtree under the unknown being inspected as finished. */
+static inline void tree_done ()
+{
+  thr_stats[thread_num].explored += tree_weight;
+}
+
+/* Publish this thread's progress, trying a state of unknown DEPTH, check
+   in if a checkpoint is wanted, and stop the search if a budget has run
+   out, checkpointing it first. */
+static void search_tick (int depth)
+{
+  LOCK;
+  progress_publish (&thr_stats[thread_num]);
+  bool out = (node_budget >= 0 && progress.nodes >= node_budget)
+    || (time_budget >= 0 && now_ms () >= budget_deadline);
+  if (out && ckpt_file && !atomic_load (&budget_out))
+    {
+      atomic_store (&budget_out, true);
+      atomic_store (&ckpt_wanted, true);
+    }
+  if (atomic_load (&ckpt_wanted))
+    ckpt_check_in (depth);
+  UNLOCK;
+  if (out)
+    {
+      atomic_store (&budget_out, true);
+      atomic_store (&search_stop, true);
+    }
+}
+
+/* Add what the statistics ST count beyond what they last published into
+   PROGRESS. Must hold THR_LOCK. */
+static void progress_publish (struct stats *st)
+{
+  progress.nodes += st->nodes - st->pub.nodes;
+  progress.explored += st->explored - st->pub.explored;
+  progress.goals += st->goals - st->pub.goals;
+  st->pub.nodes = st->nodes;
+  st->pub.explored = st->explored;
+  st->pub.goals = st->goals;
+}
+
+/* Until the search is over, report its progress to stderr every
+   PROGRESS_SECS: the fraction of the tree explored, nodes tried and their
+   rate, solutions found, and the time left were the rest of the tree as
+   fast. Ask for a checkpoint every CKPT_SECS. */
+static void * monitor_thr (void *data)
+{
+  (void) data;
+
+  // A resumed search starts part way.
+  LOCK;
+  double base = progress.explored;
+  UNLOCK;
+  double start = now_ms ();
+  double next_progress = progress_secs > 0 ? start + progress_secs * 1000
+    : HUGE_VAL;
+  double next_ckpt = ckpt_file ? start + ckpt_secs * 1000 : HUGE_VAL;
+
+  pthread_mutex_lock (&monitor_lock);
+  while (!monitor_done)
+    {
+      // Wait on the clock the cond var keeps, from the time left.
+      double next = next_progress < next_ckpt ? next_progress : next_ckpt;
+      double wait = next - now_ms ();
+      struct timespec wake;
+      clock_gettime (CLOCK_REALTIME, &wake);
+      long long ns = wake.tv_nsec + (long long) ((wait > 0 ? wait : 0) * 1e6);
+      wake.tv_sec += ns / 1000000000;
+      wake.tv_nsec = ns % 1000000000;
+      if (!monitor_done)
+        pthread_cond_timedwait (&monitor_cond, &monitor_lock, &wake);
+      if (monitor_done)
+        break;
+
+      double now = now_ms ();
+      if (now >= next_ckpt)
+        {
+          atomic_store (&ckpt_wanted, true);
+          next_ckpt = now + ckpt_secs * 1000;
+        }
+      if (now < next_progress)
+        continue;
+      next_progress += progress_secs * 1000;
+
+      LOCK;
+      struct progress done = progress;
+      UNLOCK;
+      double secs = (now - start) / 1000;
+      fprintf (stderr, "Progress: %.4f%% explored, %lld nodes, %.0f nodes/s, "
+               "%lld solutions, ", 100 * done.explored, done.nodes,
+               secs > 0 ? done.nodes / secs : 0, done.goals);
+      if (done.explored > base)
+        fprintf (stderr, "%.0f s left\n",
+                 secs * (1 - done.explored) / (done.explored - base));
+      else
+        fprintf (stderr, "time left unknown\n");
+    }
+  pthread_mutex_unlock (&monitor_lock);
+  return NULL;
+}
+
+/* Whether the search tries both states of unknown U, with MINE_COUNT mines
+   on the unknowns before it, as solve_tree () decides. */
+static inline bool two_branch (int u, int mine_count)
+{
+  return mine_target == -1 || (mine_count < mine_target
+                               && mine_target - mine_count
+                               != total_unknowns - u);
+}
+
+/* Append a prefix to F, and return it. */
+static struct prefix * frontier_push (struct frontier *f)
+{
+  if (f->n == f->cap)
+    {
+      f->cap = f->cap ? 2 * f->cap : 64;
+      f->p = (struct prefix *) realloc (f->p, f->cap * sizeof *f->p);
+    }
+  return &f->p[f->n++];
+}
+
+/* Add the prefix of the LEN unknowns of IND as they are on GRID to F, with
+   the last one on if LAST_ON, and HALVES as its weight. */
+static void frontier_add (struct frontier *f, int **grid, struct ind *ind,
+                          int len, bool last_on, int halves)
+{
+  prefix_make (frontier_push (f), grid, ind, len, last_on, halves);
+}
+
+/* Set P to the prefix of the LEN unknowns of IND as they are on GRID, with
+   the last one on if LAST_ON, and HALVES as its weight. */
+static void prefix_make (struct prefix *p, int **grid, struct ind *ind,
+                         int len, bool last_on, int halves)
+{
+  p->len = len;
+  p->halves = halves;
+  p->bits = (unsigned char *) calloc ((len + 7) / 8 + 1, 1);
+  int i;
+  for (i = 0; i < len; i++)
+    if (is_mine (grid[ind[i].row][ind[i].col]) || (last_on && i == len - 1))
+      p->bits[i / 8] |= 1 << (i % 8);
+}
+
+/* Check this thread in for the checkpoint wanted, while trying a state of
+   unknown DEPTH, and wait for it to be written. What the thread has yet to
+   search is read off its decision stack: the on state of each unknown it
+   is trying the off state of, unless it handed that off, and the subtree
+   it is in now. Everything before them in search order is done, and with
+   it every solution claimed. Must hold THR_LOCK. */
+static void ckpt_check_in (int depth)
+{
+  struct buffers bufs = thr_data[thread_num].bufs;
+  struct frame *stack = thr_data[thread_num].stack;
+  int mine_count = 0;
+  int halves = 0;
+  int i, k = 0;
+  for (i = 0; i <= depth; i++)
+    {
+      int tile = bufs.grid[bufs.ind[i].row][bufs.ind[i].col];
+      if (mine_src (tile) == i && two_branch (i, mine_count))
+        {
+          // The unknowns before the thread's subtree have no frames.
+          halves++;
+          while (k < stack_len && stack[k].unknown < i)
+            k++;
+          if (k < stack_len && stack[k].unknown == i
+              && stack[k].state == FRAME_OFF)
+            frontier_add (&ckpt_open, bufs.grid, bufs.ind, i + 1, true,
+                          halves);
+        }
+      mine_count += is_mine (tile);
+    }
+  frontier_add (&ckpt_open, bufs.grid, bufs.ind, depth + 1, false, halves);
+
+  ckpt_in++;
+  int gen = ckpt_gen;
+  ckpt_ready ();
+  while (ckpt_gen == gen)
+    pthread_cond_wait (thr_cond, thr_lock);
+}
+
+/* Write the checkpoint wanted once every thread still searching has checked
+   in, and let them go on. Must hold THR_LOCK. */
+static void ckpt_ready ()
+{
+  if (!atomic_load (&ckpt_wanted) || !ckpt_in
+      || ckpt_in < max_threads - avail_threads)
+    return;
+
+  ckpt_write (ckpt_file, &ckpt_open);
+  int i;
+  for (i = 0; i < ckpt_open.n; i++)
+    free (ckpt_open.p[i].bits);
+  ckpt_open.n = 0;
+  ckpt_in = 0;
+  atomic_store (&ckpt_wanted, false);
+  ckpt_gen++;
+  pthread_cond_broadcast (thr_cond);
+}
+
+/* Snapshot the grid the search starts from, and hash it and the options
+   that shape the search tree into the key of its checkpoints. */
+static void ckpt_setup ()
+{
+  int i;
+  ckpt_grid = (int *) malloc (ntiles * sizeof (int));
+  memcpy (ckpt_grid, thr_data[0].bufs.buf, ntiles * sizeof (int));
+  ckpt_key = 14695981039346656037ULL;
+  int opts[] = {nrows, ncols, total_unknowns, force, sort, single,
+                mine_target};
+  for (i = 0; i < (int) (sizeof opts / sizeof opts[0]); i++)
+    ckpt_key = (ckpt_key ^ (uint32_t) opts[i]) * 1099511628211ULL;
+  for (i = 0; i < ntiles; i++)
+    ckpt_key = (ckpt_key ^ (uint32_t) ckpt_grid[i]) * 1099511628211ULL;
+  ckpt_goals = ckpt_nodes = 0;
+  ckpt_done = 0;
+  ckpt_in = 0;
+  ckpt_root.len = ckpt_root.halves = 0;
+  ckpt_root.bits = (unsigned char *) calloc (1, 1);
+}
+
+/* Write a checkpoint to FILE: "MSCKPT03", the key of the search (a
+   uint64_t), the number of unknowns (an int), the goal states found and
+   nodes tried (long longs), and the share of the tree done (a double).
+   Then the options that shape the tree, -f, -s, -a and -m, as ints, the
+   last as given before the mines on the grid count against it, and the
+   grid the search starts from, as in a binary grid stream. Then the number
+   of open prefixes (an int), and for each its length, halves, and the
+   number of bits it shares with the one before (ints), and the rest of its
+   bits, packed 8 to a byte from the lowest. Last, CKPT_ROOT, the subtree
+   the checkpoint covers, as its length and halves (ints) and its bits.
+   The prefixes are OPEN, the subtrees the threads checked in have yet to
+   search, and those left of a resumed checkpoint. The open siblings of a
+   thread's path share most of it, so they take little room. With the grid
+   and options, the file is a work unit of its own, for --unit.
+   It is written aside and renamed over FILE, so that a crash leaves the
+   last one whole. Threads searching must be checked in. */
+static void ckpt_write (char *file, struct frontier *open)
+{
+  long long goals = ckpt_goals;
+  long long nodes = ckpt_nodes;
+  double explored = ckpt_done;
+  int nopen = open->n + resume_open.n - resume_next;
+  int i, j;
+  for (i = 0; i < max_threads; i++)
+    {
+      goals += thr_stats[i].goals;
+      nodes += thr_stats[i].nodes;
+      explored += thr_stats[i].explored;
+    }
+
+  char *tmp = (char *) malloc (strlen (file) + 5);
+  sprintf (tmp, "%s.tmp", file);
+  FILE *fh = fopen (tmp, "wb");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", tmp);
+      exit (1);
+    }
+  fwrite ("MSCKPT03", 1, 8, fh);
+  fwrite (&ckpt_key, sizeof ckpt_key, 1, fh);
+  fwrite (&total_unknowns, sizeof (int), 1, fh);
+  fwrite (&goals, sizeof goals, 1, fh);
+  fwrite (&nodes, sizeof nodes, 1, fh);
+  fwrite (&explored, sizeof explored, 1, fh);
+
+  // Preprocessing took the mines on the grid off the target.
+  int mines = 0;
+  for (i = 0; i < ntiles; i++)
+    mines += is_mine (ckpt_grid[i]);
+  int opts[] = {force, sort, single,
+                mine_target >= 0 ? mine_target + mines : mine_target,
+                nrows - 2, ncols - 2};
+  fwrite (opts, sizeof (int), 6, fh);
+  size_t npacked = ((size_t) (nrows - 2) * (ncols - 2) + 1) / 2;
+  unsigned char *packed = (unsigned char *) calloc (npacked, 1);
+  size_t t = 0;
+  for (i = 1; i < nrows - 1; i++)
+    for (j = 1; j < ncols - 1; j++, t++)
+      {
+        int tile = ckpt_grid[i * ncols + j];
+        int code = tile >= 0 && tile <= 8 ? tile : tile == UNKNOWN ? 9
+          : is_mine (tile) ? 10 : 11;
+        packed[t / 2] |= code << (t % 2 * 4);
+      }
+  fwrite (packed, 1, npacked, fh);
+  free (packed);
+
+  fwrite (&nopen, sizeof (int), 1, fh);
+  struct prefix *last = NULL;
+  unsigned char *rest = (unsigned char *) malloc (total_unknowns / 8 + 2);
+  for (j = 0; j < 2; j++)
+    {
+      struct frontier *f = j ? &resume_open : open;
+      for (i = j ? resume_next : 0; i < f->n; i++)
+        {
+          struct prefix *p = &f->p[i];
+          int shared = 0;
+          int k;
+          while (last && shared < p->len && shared < last->len
+                 && (p->bits[shared / 8] >> (shared % 8) & 1)
+                 == (last->bits[shared / 8] >> (shared % 8) & 1))
+            shared++;
+          memset (rest, 0, (p->len - shared + 7) / 8);
+          for (k = shared; k < p->len; k++)
+            if (p->bits[k / 8] >> (k % 8) & 1)
+              rest[(k - shared) / 8] |= 1 << ((k - shared) % 8);
+          fwrite (&p->len, sizeof (int), 1, fh);
+          fwrite (&p->halves, sizeof (int), 1, fh);
+          fwrite (&shared, sizeof (int), 1, fh);
+          fwrite (rest, 1, (p->len - shared + 7) / 8, fh);
+          last = p;
+        }
+    }
+  free (rest);
+  fwrite (&ckpt_root.len, sizeof (int), 1, fh);
+  fwrite (&ckpt_root.halves, sizeof (int), 1, fh);
+  fwrite (ckpt_root.bits, 1, (ckpt_root.len + 7) / 8, fh);
+  if (fclose (fh) || rename (tmp, file))
+    {
+      fprintf (stderr, "Could not write %s.\n", file);
+      exit (1);
+    }
+  free (tmp);
+}
+
+/* Read the header of the checkpoint in FH, as ckpt_write () writes it, up
+   to the grid: its key, number of unknowns, goal states, nodes, share of
+   the tree done, and into OPTS its 6 ints of options and dimensions.
+   Returns false if it is not a checkpoint. */
+static bool ckpt_header (FILE *fh, uint64_t *key, int *nunknowns,
+                         long long *goals, long long *nodes, double *done,
+                         int *opts)
+{
+  char magic[8];
+  return fread (magic, 1, 8, fh) == 8 && !memcmp (magic, "MSCKPT03", 8)
+    && fread (key, sizeof *key, 1, fh) == 1
+    && fread (nunknowns, sizeof (int), 1, fh) == 1
+    && fread (goals, sizeof *goals, 1, fh) == 1
+    && fread (nodes, sizeof *nodes, 1, fh) == 1
+    && fread (done, sizeof *done, 1, fh) == 1
+    && fread (opts, sizeof (int), 6, fh) == 6
+    && opts[4] > 0 && opts[5] > 0;
+}
+
+/* Read the checkpoint in RESUME_FILE, written by ckpt_write () for the same
+   grid and options, adding its prefixes to RESUME_OPEN, and its goal
+   states, nodes and share of the tree done to CKPT_GOALS, CKPT_NODES and
+   CKPT_DONE. The subtree it covers replaces CKPT_ROOT. */
+static void ckpt_load ()
+{
+  FILE *fh = fopen (resume_file, "rb");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", resume_file);
+      exit (1);
+    }
+  uint64_t key;
+  long long goals, nodes;
+  double done;
+  int nunknowns, nopen, i;
+  int opts[6];
+  bool ok = ckpt_header (fh, &key, &nunknowns, &goals, &nodes, &done, opts);
+  if (ok && (key != ckpt_key || nunknowns != total_unknowns))
+    {
+      fprintf (stderr, "Checkpoint %s is of another grid or options.\n",
+               resume_file);
+      exit (1);
+    }
+
+  // The key covers the grid.
+  ok = ok && !fseek (fh, ((long) opts[4] * opts[5] + 1) / 2, SEEK_CUR)
+    && fread (&nopen, sizeof (int), 1, fh) == 1 && nopen >= 0;
+  unsigned char *rest = (unsigned char *) malloc (total_unknowns / 8 + 2);
+  for (i = 0; ok && i < nopen; i++)
+    {
+      struct prefix *last = resume_open.n ? &resume_open.p[resume_open.n-1]
+        : NULL;
+      int len, halves, shared, k;
+      ok = fread (&len, sizeof (int), 1, fh) == 1
+        && fread (&halves, sizeof (int), 1, fh) == 1
+        && fread (&shared, sizeof (int), 1, fh) == 1
+        && len >= 0 && len <= total_unknowns && shared >= 0 && shared <= len
+        && (i || !shared) && (!i || shared <= last->len)
+        && fread (rest, 1, (len - shared + 7) / 8, fh)
+        == (size_t) (len - shared + 7) / 8;
+      if (!ok)
+        break;
+      struct prefix *p = frontier_push (&resume_open);
+      last = i ? p - 1 : NULL;
+      p->len = len;
+      p->halves = halves;
+      p->bits = (unsigned char *) calloc ((len + 7) / 8 + 1, 1);
+      if (shared)
+        memcpy (p->bits, last->bits, (shared + 7) / 8);
+      if (shared % 8)
+        p->bits[shared / 8] &= (1 << (shared % 8)) - 1;
+      for (k = shared; k < len; k++)
+        if (rest[(k - shared) / 8] >> ((k - shared) % 8) & 1)
+          p->bits[k / 8] |= 1 << (k % 8);
+    }
+  free (rest);
+  int len, halves;
+  ok = ok && fread (&len, sizeof (int), 1, fh) == 1
+    && fread (&halves, sizeof (int), 1, fh) == 1
+    && len >= 0 && len <= total_unknowns && halves >= 0 && halves <= len;
+  if (ok)
+    {
+      free (ckpt_root.bits);
+      ckpt_root.len = len;
+      ckpt_root.halves = halves;
+      ckpt_root.bits = (unsigned char *) calloc ((len + 7) / 8 + 1, 1);
+      ok = fread (ckpt_root.bits, 1, (len + 7) / 8, fh)
+        == (size_t) (len + 7) / 8;
+    }
+  fclose (fh);
+  if (!ok)
+    {
+      fprintf (stderr, "Invalid checkpoint %s.\n", resume_file);
+      exit (1);
+    }
+  ckpt_goals += goals;
+  ckpt_nodes += nodes;
+  ckpt_done += done;
+  resume_next = 0;
+}
+
+/* Set the grid of BUFS back to the one the search starts from, then assign
+   it prefix P, forcing as the search would. Only the unknowns differ from
+   it, so this takes time in the number of unknowns and the length of P,
+   not in the size of the grid. Sets MINE_COUNT to the mines on it. Returns
+   false if it is inconsistent. */
+static bool prefix_replay (struct buffers bufs, struct prefix *p,
+                           int *mine_count)
+{
+  int i;
+  for (i = 0; i < total_unknowns; i++)
+    bufs.grid[bufs.ind[i].row][bufs.ind[i].col] = UNKNOWN;
+
+  // The search counted the forcing redone here already.
+  long long forced = thr_stats[thread_num].forced;
+  bool consis = true;
+  *mine_count = 0;
+  for (i = 0; consis && i < p->len; i++)
+    {
+      int *tile = &bufs.grid[bufs.ind[i].row][bufs.ind[i].col];
+      bool on = p->bits[i / 8] >> (i % 8) & 1;
+      if (mine_src (*tile) >= 0)
+        {
+          // Forced by an unknown before it.
+          consis = is_mine (*tile) == on
+            && consistency_check (bufs.ind[i], bufs.grid, i, false);
+        }
+      else
+        {
+          // Everything after it is still unknown, or forced before it, so
+          // there is nothing to clear.
+          *tile = on ? force_on (i) : force_off (i);
+          consis = consistency_check (bufs.ind[i], bufs.grid, i, true);
+        }
+      *mine_count += on;
+    }
+  thr_stats[thread_num].forced = forced;
+  return consis;
+}
+
+/* Replay prefix P onto BUFS, as prefix_replay () does, and go on to the
+   next unknown the search would try both states of, forcing as it would
+   on the way. Returns that unknown, TOTAL_UNKNOWNS if the subtree is a
+   whole assignment, or -1 if it is inconsistent. Sets MINE_COUNT to the
+   mines before it. */
+static int prefix_branch (struct buffers bufs, struct prefix *p,
+                          int *mine_count)
+{
+  bool open = prefix_replay (bufs, p, mine_count);
+  int u;
+  for (u = p->len; open && u < total_unknowns; u++)
+    {
+      int *tile = &bufs.grid[bufs.ind[u].row][bufs.ind[u].col];
+      if (mine_src (*tile) >= 0)
+        open = consistency_check (bufs.ind[u], bufs.grid, u, false);
+      else if (two_branch (u, *mine_count))
+        break;
+      else if (*mine_count > mine_target)
+        open = false;
+      else
+        {
+          *tile = *mine_count == mine_target ? force_off (u) : force_on (u);
+          clear_unknowns (u, bufs.ind, bufs.grid);
+          open = consistency_check (bufs.ind[u], bufs.grid, u, true);
+        }
+      *mine_count += open && is_mine (*tile);
+    }
+  return open ? u : -1;
+}
+
+/* Split the search into work units, and write them to CUBE_FILE.1, .2 and
+   on. Subtrees are split breadth first at the unknowns the search would
+   try both states of, CUBE_DEPTH such levels down, or with CUBE_NODES,
+   until the tree under each is estimated at most that many nodes. Each
+   unit is a checkpoint with one subtree open, for --unit, that covers
+   that subtree alone. What splitting found, with --resume along with what
+   the checkpoint had, goes to CUBE_FILE.0, a checkpoint with every unit
+   open, so that merging it finds the units missing. With --resume, the
+   subtrees the checkpoint left open are split instead of the whole tree. */
+static void cube_split ()
+{
+  struct frontier queue = {0, 0, NULL};
+  struct frontier units = {0, 0, NULL};
+  struct buffers bufs = thr_data[0].bufs;
+  int head, i;
+  ckpt_setup ();
+  if (resume_file)
+    {
+      ckpt_load ();
+      queue = resume_open;
+      memset (&resume_open, 0, sizeof resume_open);
+    }
+  else
+    {
+      struct prefix *root = frontier_push (&queue);
+      root->len = 0;
+      root->halves = 0;
+      root->bits = (unsigned char *) calloc (1, 1);
+    }
+
+  for (head = 0; head < queue.n; head++)
+    {
+      struct prefix p = queue.p[head];
+      double weight = ldexp (1, -p.halves);
+      int mine_count;
+      int u = prefix_branch (bufs, &p, &mine_count);
+      bool open = u >= 0;
+
+      bool small = false;
+      if (open && u < total_unknowns && cube_nodes > 0)
+        {
+          double nodes, err, ms;
+          tree_estimate (u, mine_count, probes ? probes : ENGINE_PROBES,
+                         &nodes, &err, &ms);
+          small = nodes <= cube_nodes;
+        }
+      else if (open)
+        small = p.halves >= cube_depth;
+
+      if (!open || u == total_unknowns)
+        {
+          // A whole assignment, or none.
+          if (open && (mine_target == -1 || mine_count == mine_target))
+            {
+              ckpt_goals++;
+              if (print >= PRINT_ALL)
+                board_print (bufs.grid);
+            }
+          ckpt_done += weight;
+          free (p.bits);
+        }
+      else if (small)
+        *frontier_push (&units) = p;
+      else
+        {
+          frontier_add (&queue, bufs.grid, bufs.ind, u + 1, false,
+                        p.halves + 1);
+          frontier_add (&queue, bufs.grid, bufs.ind, u + 1, true,
+                        p.halves + 1);
+          free (p.bits);
+        }
+    }
+  free (queue.p);
+
+  // What was found here covers the whole tree, or the checkpoint's, less
+  // the units. Each unit covers its subtree and nothing else.
+  char *name = (char *) malloc (strlen (cube_file) + 16);
+  struct prefix scope = ckpt_root;
+  sprintf (name, "%s.0", cube_file);
+  ckpt_write (name, &units);
+  ckpt_goals = ckpt_nodes = 0;
+  ckpt_done = 0;
+  for (i = 0; i < units.n; i++)
+    {
+      struct frontier one = {1, 1, units.p + i};
+      sprintf (name, "%s.%d", cube_file, i + 1);
+      ckpt_root = units.p[i];
+      ckpt_write (name, &one);
+    }
+  ckpt_root = scope;
+  free (name);
+  if (print >= PRINT_BASIC)
+    {
+      if (units.n)
+        printf ("Work units: %d, written to %s.1 to %s.%d\n", units.n,
+                cube_file, cube_file, units.n);
+      else
+        printf ("Work units: 0\n");
+      printf ("What splitting found: written to %s.0\n", cube_file);
+    }
+
+  for (i = 0; i < units.n; i++)
+    free (units.p[i].bits);
+  free (units.p);
+  free (ckpt_grid);
+  free (ckpt_root.bits);
+}
+
+/* Read the grid and options of the checkpoint or work unit in FILE into
+   thread 0's buffers, as parse_input () reads a grid. Its grid is as the
+   search starts from it, so there is nothing to pre-resolve. */
+static void unit_open (char *file)
+{
+  FILE *fh = fopen (file, "rb");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", file);
+      exit (1);
+    }
+  uint64_t key;
+  long long goals, nodes;
+  double done;
+  int nunknowns;
+  int opts[6];
+  if (!ckpt_header (fh, &key, &nunknowns, &goals, &nodes, &done, opts))
+    {
+      fprintf (stderr, "Invalid checkpoint %s.\n", file);
+      exit (1);
+    }
+  force = opts[0];
+  sort = opts[1];
+  single = opts[2];
+  mine_target = opts[3];
+  preresolve = false;
+  eliminate = false;
+
+  // The grid is laid out as in a binary grid stream, after its header.
+  fseek (fh, -2 * (long) sizeof (int), SEEK_CUR);
+  binary_input = true;
+  parse_stream (fh);
+  binary_input = false;
+  fclose (fh);
+}
+
+/* Merge the results of work units in the NFILES checkpoints of FILES,
+   written by --unit with --checkpoint for units of the same search, or
+   by --cube: add up their goal states, nodes and shares of the tree done,
+   and gather the subtrees left to search, as merge_walk () finds them.
+   Results that cover the same subtree, or more than the whole tree
+   between them, are an error. Print the totals, and write a checkpoint of
+   them to CKPT_FILE, if set, to resume what is left with --unit. The search
+   is done once the whole tree is, or with a single solution wanted, once
+   one is found; otherwise the exit status is 2, as for a budget. */
+static void merge_results (char **files, int nfiles)
+{
+  if (nfiles < 1)
+    {
+      fprintf (stderr, "No results to merge.\n");
+      exit (1);
+    }
+
+  // The first result gives the grid and options.
+  int level = print;
+  int i;
+  print = PRINT_NONE;
+  thread_alloc ();
+  unit_open (files[0]);
+  preprocess_grid ();
+  print = level;
+  ckpt_setup ();
+
+  // Keep what each covers and left open apart.
+  struct merge m;
+  int nitems = 0;
+  int k;
+  m.files = files;
+  m.roots = (struct prefix *) malloc (nfiles * sizeof *m.roots);
+  m.open = (struct frontier *) malloc (nfiles * sizeof *m.open);
+  for (i = 0; i < nfiles; i++)
+    {
+      resume_file = files[i];
+      ckpt_load ();
+      m.roots[i] = ckpt_root;
+      m.open[i] = resume_open;
+      ckpt_root.bits = NULL;
+      memset (&resume_open, 0, sizeof resume_open);
+      nitems += 1 + m.open[i].n;
+    }
+  struct merge_item *items =
+    (struct merge_item *) malloc (nitems * sizeof *items);
+  nitems = 0;
+  for (i = 0; i < nfiles; i++)
+    for (k = -1; k < m.open[i].n; k++)
+      {
+        items[nitems].res = i;
+        items[nitems++].open = k;
+      }
+
+  // The merged checkpoint covers the whole tree.
+  ckpt_root.len = ckpt_root.halves = 0;
+  ckpt_root.bits = (unsigned char *) calloc (1, 1);
+  merge_walk (&m, &ckpt_root, items, nitems, -1, true);
+  if (ckpt_done > 1 + 1e-9)
+    {
+      fprintf (stderr, "Results explored more than the whole tree.\n");
+      exit (1);
+    }
+
+  bool done = !ckpt_open.n && (ckpt_done > 1 - 1e-9
+                               || (single && ckpt_goals));
+  if (print >= PRINT_BASIC)
+    {
+      printf ("Results merged: %d\n", nfiles);
+      printf ("Nodes: %lld\n", ckpt_nodes);
+      printf ("Explored: %.4f%% of the search tree\n", 100 * ckpt_done);
+      printf ("Subtrees left: %d\n", ckpt_open.n);
+      printf ("Number of goal states: %lld\n", ckpt_goals);
+    }
+  if (ckpt_file)
+    ckpt_write (ckpt_file, &ckpt_open);
+  budget_hit = !done;
+
+  free (ckpt_grid);
+  free (ckpt_root.bits);
+  for (i = 0; i < nfiles; i++)
+    {
+      free (m.roots[i].bits);
+      for (k = 0; k < m.open[i].n; k++)
+        free (m.open[i].p[k].bits);
+      free (m.open[i].p);
+    }
+  for (i = 0; i < ckpt_open.n; i++)
+    free (ckpt_open.p[i].bits);
+  free (ckpt_open.p);
+  memset (&ckpt_open, 0, sizeof ckpt_open);
+  free (m.roots);
+  free (m.open);
+  free (items);
+  thread_free ();
+}
+
+/* Whether result RES left open one of the N ITEMS. */
+static bool merge_left (struct merge_item *items, int n, int res)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    if (items[i].res == res && items[i].open >= 0)
+      return true;
+  return false;
+}
+
+/* Walk the subtree under prefix NODE for merge_results (), with the N
+   ITEMS of M in it. OWNER is the result whose root NODE is under, if any,
+   and UNCOVERED whether NODE is under one of the subtrees it left open, or
+   under no root, so that no result has searched it. A result whose root is
+   where another has searched overlaps it. The walk goes down the unknowns
+   the search tries both states of, as --cube splits, until no item is
+   further down. There, a subtree no result has searched is left open, or
+   counted, if forcing ends it before it branches, as splitting did. */
+static void merge_walk (struct merge *m, struct prefix *node,
+                        struct merge_item *items, int n, int owner,
+                        bool uncovered)
+{
+  struct buffers bufs = thr_data[0].bufs;
+  int mine_count;
+  int u = prefix_branch (bufs, node, &mine_count);
+  int end = u >= 0 ? u : total_unknowns;
+  struct merge_item tmp;
+  int i, j, k;
+
+  // Items that end before U are this subtree. Put them first.
+  for (i = k = 0; i < n; i++)
+    {
+      struct merge_item it = items[i];
+      struct prefix *p = it.open < 0 ? &m->roots[it.res]
+        : &m->open[it.res].p[it.open];
+      if (p->len <= end)
+        {
+          tmp = items[k];
+          items[k++] = it;
+          items[i] = tmp;
+        }
+    }
+  // A root needs the subtree left open by the result it is under, and
+  // starts what its result covers. Of roots of this subtree, those whose
+  // result left it open, as --cube leaves its units, go first.
+  for (i = 0; i < k; i++)
+    if (items[i].open >= 0 && items[i].res == owner)
+      uncovered = true;
+  for (j = 0; j < 2; j++)
+    for (i = 0; i < k; i++)
+      if (items[i].open < 0 && merge_left (items, k, items[i].res) == !j)
+        {
+          if (!uncovered)
+            {
+              fprintf (stderr, "Results %s and %s overlap.\n",
+                       m->files[owner], m->files[items[i].res]);
+              exit (1);
+            }
+          owner = items[i].res;
+          uncovered = !j;
+        }
+
+  if (k == n || end == total_unknowns)
+    {
+      double weight = ldexp (1, -node->halves);
+      if (!uncovered)
+        return;
+      if (u < 0)
+        ckpt_done += weight;
+      else if (u == total_unknowns)
+        {
+          ckpt_done += weight;
+          if (mine_target == -1 || mine_count == mine_target)
+            ckpt_goals++;
+        }
+      else
+        {
+          struct prefix *p = frontier_push (&ckpt_open);
+          *p = *node;
+          p->bits = (unsigned char *) malloc ((node->len + 7) / 8 + 1);
+          memcpy (p->bits, node->bits, (node->len + 7) / 8 + 1);
+        }
+      return;
+    }
+
+  // The rest are under one state of U or the other.
+  for (i = j = k; i < n; i++)
+    {
+      struct merge_item it = items[i];
+      struct prefix *p = it.open < 0 ? &m->roots[it.res]
+        : &m->open[it.res].p[it.open];
+      if (!(p->bits[u / 8] >> (u % 8) & 1))
+        {
+          tmp = items[j];
+          items[j++] = it;
+          items[i] = tmp;
+        }
+    }
+  struct prefix off, on;
+  prefix_make (&off, bufs.grid, bufs.ind, u + 1, false, node->halves + 1);
+  prefix_make (&on, bufs.grid, bufs.ind, u + 1, true, node->halves + 1);
+  merge_walk (m, &off, items + k, j - k, owner, uncovered);
+  merge_walk (m, &on, items + j, n - j, owner, uncovered);
+  free (off.bits);
+  free (on.bits);
+}
+
+/* Report what a search stopped by a budget knows: whether it found a
+   solution, the fraction of the tree it explored, and the unknowns of GRID,
+   the grid it started from, that are forced in every solution. Those are
+   found by resolving around every numbered tile until nothing more
+   resolves. */
+static void budget_report (int **grid)
+{
+  // Every thread has published all it counted.
+  int i, j;
+  printf ("Search stopped by its %s budget after %lld nodes.\n",
+          node_budget >= 0 && progress.nodes >= node_budget
+          ? "node" : "time", progress.nodes);
+  printf ("Explored: %.4f%% of the search tree\n", 100 * progress.explored);
+  printf ("Solution found: %s\n", goal_states ? "yes" : "no");
+
+  // Only the search's own forcing counts in the statistics.
+  long long forced = thr_stats[thread_num].forced;
+  for (i = 1; i < nrows - 1; i++)
+    for (j = 1; j < ncols - 1; j++)
+      if (grid[i][j] >= 0 && grid[i][j] <= 8)
+        resolve_around (grid, i, j);
+  thr_stats[thread_num].forced = forced;
+
+  int left = 0;
+  for (i = 1; i < nrows - 1; i++)
+    for (j = 1; j < ncols - 1; j++)
+      left += grid[i][j] == UNKNOWN;
+  printf ("Forced unknowns: %d\n", total_unknowns - left);
+  if (left < total_unknowns)
+    board_print (grid);
+}
+
+/* Claim a solution just found. When a single solution is wanted, only the
+   first thread to find one gets it, and the others stop. */
+static inline bool goal_claim ()
+{
+  if (single && atomic_exchange (&search_stop, true))
+    return false;
+  thr_stats[thread_num].goals++;
+  return true;
+}
+
+/* Returns the index of the unknown tile that forced this mine to be on or
+   off. -1 is returned if TILE_VAL denotes an unknown or a number, or if this
+   mine was forced to be on/off from the start. */
+static inline int mine_src (int tile_val)
+{
+  int n = abs (tile_val);
+  if (n <= MINE_ON)
+    return -1;
+  else
+    return (n - MINE_ON - 1);
+}
+
+
+
+/*****************************************************************************
+ *
+ *  Constraint system functions.
+ *
+ ****************************************************************************/
+
+/* Build the constraint system over the NUNKNOWNS unknowns in IND. Every
+   numbered tile next to an unknown becomes a constraint, less the mines
+   already placed around it. Components are found breadth first, so that
+   variables near each other in the grid stay near each other in
+   COMP_VARS. */
+static struct csp * csp_build (int **grid, struct ind *ind, int nunknowns)
+{
+  struct csp *csp = (struct csp *) calloc (1, sizeof *csp);
+  csp->nvars = nunknowns;
+  csp->vars = (struct ind *) malloc ((nunknowns + 1) * sizeof (struct ind));
+  memcpy (csp->vars, ind, nunknowns * sizeof (struct ind));
+
+  // Map tiles to variable and constraint numbers.
+  int *var_of = (int *) malloc (ntiles * sizeof (int));
+  int *con_of = (int *) malloc (ntiles * sizeof (int));
+  int i, j, k, l, m;
+  for (i = 0; i < ntiles; i++)
+    var_of[i] = con_of[i] = -1;
+  for (i = 0; i < nunknowns; i++)
+    var_of[ind[i].row * ncols + ind[i].col] = i;
+
+  // Create a constraint for each numbered tile around each unknown.
+  int cap = 16;
+  int *nvar_cons = (int *) calloc (nunknowns + 1, sizeof (int));
+  csp->cons = (struct constraint *) malloc (cap * sizeof *csp->cons);
+  for (i = 0; i < nunknowns; i++)
+    for (j = -1; j < 2; j++)
+      for (k = -1; k < 2; k++)
+        {
+          int row = ind[i].row + j;
+          int col = ind[i].col + k;
+          int tile_num = grid[row][col];
+          if (tile_num < 0 || tile_num > 8 || con_of[row * ncols + col] >= 0)
+            continue;
+
+          if (csp->ncons == cap)
+            {
+              cap *= 2;
+              csp->cons = (struct constraint *)
+                realloc (csp->cons, cap * sizeof *csp->cons);
+            }
+          struct constraint *con = &csp->cons[csp->ncons];
+          con_of[row * ncols + col] = csp->ncons++;
+          con->index.row = row;
+          con->index.col = col;
+          con->need = tile_num;
+          con->nvars = 0;
+          for (l = -1; l < 2; l++)
+            for (m = -1; m < 2; m++)
+              {
+                int v = var_of[(row + l) * ncols + col + m];
+                if (v >= 0)
+                  {
+                    con->vars[con->nvars++] = v;
+                    nvar_cons[v]++;
+                  }
+                else if (is_mine (grid[row+l][col+m]))
+                  con->need--;
+              }
+          if (con->need < 0 || con->need > con->nvars)
+            csp->unsat = true;
+        }
+  free (var_of);
+  free (con_of);
+
+  // Group constraints by variable.
+  int *start = (int *) malloc ((nunknowns + 1) * sizeof (int));
+  start[0] = 0;
+  for (i = 0; i < nunknowns; i++)
+    start[i+1] = start[i] + nvar_cons[i];
+  csp->var_cons_start = start;
+  csp->var_cons = (int *) malloc ((start[nunknowns] + 1) * sizeof (int));
+  memcpy (nvar_cons, start, nunknowns * sizeof (int));
+  for (i = 0; i < csp->ncons; i++)
+    for (j = 0; j < csp->cons[i].nvars; j++)
+      csp->var_cons[nvar_cons[csp->cons[i].vars[j]]++] = i;
+  free (nvar_cons);
+
+  // Find the components.
+  csp->comp = (int *) malloc ((nunknowns + 1) * sizeof (int));
+  csp->comp_vars = (int *) malloc ((nunknowns + 1) * sizeof (int));
+  csp->comp_start = (int *) malloc ((nunknowns + 1) * sizeof (int));
+  csp->interior = (int *) malloc ((nunknowns + 1) * sizeof (int));
+  for (i = 0; i < nunknowns; i++)
+    csp->comp[i] = -1;
+  int tail = 0;
+  for (i = 0; i < nunknowns; i++)
+    {
+      if (csp->comp[i] >= 0)
+        continue;
+      if (start[i] == start[i+1])
+        {
+          csp->interior[csp->ninterior++] = i;
+          continue;
+        }
+
+      // Walk the component breadth first, from its first unknown in row
+      // order. This keeps the front of the walk narrow, and with it the
+      // decision diagrams of the component.
+      int head = tail;
+      csp->comp_start[csp->ncomps] = tail;
+      csp->comp[i] = csp->ncomps;
+      csp->comp_vars[tail++] = i;
+      while (head < tail)
+        {
+          int v = csp->comp_vars[head++];
+          for (j = start[v]; j < start[v+1]; j++)
+            {
+              struct constraint *con = &csp->cons[csp->var_cons[j]];
+              for (k = 0; k < con->nvars; k++)
+                if (csp->comp[con->vars[k]] < 0)
+                  {
+                    csp->comp[con->vars[k]] = csp->ncomps;
+                    csp->comp_vars[tail++] = con->vars[k];
+                  }
+            }
+        }
+      csp->ncomps++;
+    }
+  csp->comp_start[csp->ncomps] = tail;
+  csp->nfrontier = tail;
+
+  return csp;
+}
+
+static void csp_free (struct csp *csp)
+{
+  free (csp->vars);
+  free (csp->cons);
+  free (csp->var_cons);
+  free (csp->var_cons_start);
+  free (csp->comp);
+  free (csp->comp_vars);
+  free (csp->comp_start);
+  free (csp->interior);
+  free (csp);
+}
+
+/* Allocate search state for CSP, with every variable unassigned. */
+static struct csp_search * csp_search_alloc (struct csp *csp)
+{
+  struct csp_search *s = (struct csp_search *) malloc (sizeof *s);
+  s->csp = csp;
+  s->val = (signed char *) malloc (csp->nvars + 1);
+  s->need = (int *) malloc ((csp->ncons + 1) * sizeof (int));
+  s->free = (int *) malloc ((csp->ncons + 1) * sizeof (int));
+  s->trail = (int *) malloc ((csp->nvars + 1) * sizeof (int));
+  s->ntrail = 0;
+  s->mines = 0;
+  memset (s->val, -1, csp->nvars + 1);
+  int i;
+  for (i = 0; i < csp->ncons; i++)
+    {
+      s->need[i] = csp->cons[i].need;
+      s->free[i] = csp->cons[i].nvars;
+    }
+  return s;
+}
+
+static void csp_search_free (struct csp_search *s)
+{
+  free (s->val);
+  free (s->need);
+  free (s->free);
+  free (s->trail);
+  free (s);
+}
+
+/* Set variable V to VAL and push it on the trail. Returns false if one of
+   V's constraints can no longer be met. */
+static inline bool csp_set (struct csp_search *s, int v, int val)
+{
+  struct csp *csp = s->csp;
+  bool consis = true;
+  int i;
+  s->val[v] = val;
+  s->trail[s->ntrail++] = v;
+  s->mines += val;
+  for (i = csp->var_cons_start[v]; i < csp->var_cons_start[v+1]; i++)
+    {
+      int c = csp->var_cons[i];
+      s->need[c] -= val;
+      s->free[c]--;
+      if (s->need[c] < 0 || s->need[c] > s->free[c])
+        consis = false;
+    }
+  return consis;
+}
+
+/* Assign VAL to variable V, then force the state of every variable it
+   determines: once a constraint needs no more mines, the rest of its
+   variables are off, and once it needs as many mines as it has unassigned
+   variables, they are on. Returns false if a constraint is violated. Either
+   way, the assignments stay on the trail until undone by csp_undo (). */
+static bool csp_assign (struct csp_search *s, int v, int val)
+{
+  struct csp *csp = s->csp;
+  int head = s->ntrail;
+  int i, j;
+  if (!csp_set (s, v, val))
+    return false;
+
+  // The trail past HEAD is the propagation queue.
+  while (head < s->ntrail)
+    {
+      int u = s->trail[head++];
+      for (i = csp->var_cons_start[u]; i < csp->var_cons_start[u+1]; i++)
+        {
+          int c = csp->var_cons[i];
+          int forced_val;
+          if (s->free[c] == 0)
+            continue;
+          else if (s->need[c] == 0)
+            forced_val = 0;
+          else if (s->need[c] == s->free[c])
+            forced_val = 1;
+          else
+            continue;
+
+          struct constraint *con = &csp->cons[c];
+          for (j = 0; j < con->nvars; j++)
+            if (s->val[con->vars[j]] < 0
+                && !csp_set (s, con->vars[j], forced_val))
+              return false;
+        }
+    }
+  return true;
+}
+
+/* Undo assignments until only MARK remain on the trail. */
+static void csp_undo (struct csp_search *s, int mark)
+{
+  struct csp *csp = s->csp;
+  int i;
+  while (s->ntrail > mark)
+    {
+      int v = s->trail[--s->ntrail];
+      int val = s->val[v];
+      for (i = csp->var_cons_start[v]; i < csp->var_cons_start[v+1]; i++)
+        {
+          s->need[csp->var_cons[i]] += val;
+          s->free[csp->var_cons[i]]++;
+        }
+      s->mines -= val;
+      s->val[v] = -1;
+    }
+}
+
+/* Search for an assignment of the NSCOPE variables in SCOPE that extends the
+   current one, meets every constraint, and leaves between LO and HI mines
+   placed in total. The search stops at the first such assignment. Its
+   values are recorded in SEEN (bit 0 for off, bit 1 for on) and its mine
+   total in MINES. The search state is restored before returning.
+
+   Variables are branched on in SCOPE order. For each, the value not yet
+   seen in any solution is tried first, so that each solution found tells
+   us as much as possible. */
+static bool csp_find (struct csp_search *s, int *scope, int nscope,
+                      int lo, int hi, unsigned char *seen, int *mines)
+{
+  struct frame
+  {
+    int pos;                  // Position of the variable in SCOPE.
+    int mark;                 // Trail length before assignment.
+    int val;                  // Value assigned.
+    bool alt;                 // Other value has been tried.
+  } *stack = (struct frame *) malloc ((nscope + 1) * sizeof *stack);
+  int base = s->ntrail;
+  int depth = 0;
+  int pos = 0;
+  bool found = false;
+  int i;
+
+  while (true)
+    {
+      // Skip past assigned variables. Unassigned variables can hold at most
+      // NSCOPE - POS more mines.
+      while (pos < nscope && s->val[scope[pos]] >= 0)
+        pos++;
+      bool consis = s->mines <= hi && s->mines + (nscope - pos) >= lo;
+      if (consis && pos == nscope)
+        {
+          found = true;
+          break;
+        }
+
+      if (consis)
+        {
+          int v = scope[pos];
+          int val = (seen[v] & 1) && !(seen[v] & 2);
+          stack[depth].pos = pos;
+          stack[depth].mark = s->ntrail;
+          stack[depth].val = val;
+          stack[depth++].alt = false;
+          if (csp_assign (s, v, val))
+            continue;
+        }
+
+      // Backtrack to the latest variable with a value left to try.
+      while (depth > 0)
+        {
+          struct frame *f = &stack[depth-1];
+          csp_undo (s, f->mark);
+          if (f->alt)
+            {
+              depth--;
+              continue;
+            }
+          f->alt = true;
+          f->val = !f->val;
+          pos = f->pos;
+          if (csp_assign (s, scope[pos], f->val))
+            break;
+        }
+      if (depth == 0)
+        break;
+    }
+
+  if (found)
+    {
+      for (i = 0; i < nscope; i++)
+        seen[scope[i]] |= 1 << s->val[scope[i]];
+      if (mines)
+        *mines = s->mines;
+    }
+  csp_undo (s, base);
+  free (stack);
+  return found;
+}
+
+/* Find which unknowns are in the same state in every solution, without
+   enumerating solutions. Each component is solved once, then each unknown
+   whose other state hasn't been seen in a solution yet gets a search for a
+   solution with that state. A solution found rules out every unknown it
+   disagrees with, so most unknowns never need a search of their own. An
+   unknown with no such solution is forced, and stays fixed for the rest of
+   the searches.
+
+   With a mine target, the components are tied together by the mine count, so
+   the whole frontier is searched at once. Interior unknowns can then hold
+   anywhere from none to all of the mines the frontier leaves over. */
+static void query_forced (int **grid)
+{
+  struct csp *csp = csp_build (grid, thr_data[0].bufs.ind, total_unknowns);
+  struct csp_search *s = csp_search_alloc (csp);
+  unsigned char *seen = (unsigned char *) calloc (csp->nvars + 1, 1);
+  signed char *forced = (signed char *) malloc (csp->nvars + 1);
+  memset (forced, -1, csp->nvars + 1);
+  bool consis = !csp->unsat && mine_target >= -1;
+  int searches = 0;
+  int i, c;
+
+  int ncomps = csp->ncomps;
+  int lo = INT_MIN;
+  int hi = INT_MAX;
+  if (mine_target > -1)
+    {
+      ncomps = 1;
+      lo = mine_target - csp->ninterior;
+      hi = mine_target;
+    }
+
+  int min_mines = INT_MAX;
+  int max_mines = INT_MIN;
+  int mines;
+  for (c = 0; consis && c < ncomps; c++)
+    {
+      int *scope = csp->comp_vars + csp->comp_start[c];
+      int nscope = (mine_target > -1) ? csp->nfrontier
+        : csp->comp_start[c+1] - csp->comp_start[c];
+
+      searches++;
+      if (!csp_find (s, scope, nscope, lo, hi, seen, &mines))
+        {
+          consis = false;
+          break;
+        }
+      min_mines = mines < min_mines ? mines : min_mines;
+      max_mines = mines > max_mines ? mines : max_mines;
+
+      for (i = 0; i < nscope; i++)
+        {
+          int v = scope[i];
+          if (s->val[v] >= 0)
+            {
+              // Fixed by propagation from forced unknowns, so forced too.
+              forced[v] = s->val[v];
+              continue;
+            }
+          if (seen[v] == 3)
+            continue;
+
+          // Look for a solution with V in the state not yet seen.
+          int val = !(seen[v] & 2);
+          int mark = s->ntrail;
+          searches++;
+          bool found = csp_assign (s, v, val)
+            && csp_find (s, scope, nscope, lo, hi, seen, &mines);
+          csp_undo (s, mark);
+          if (found)
+            {
+              min_mines = mines < min_mines ? mines : min_mines;
+              max_mines = mines > max_mines ? mines : max_mines;
+            }
+          else
+            {
+              forced[v] = !val;
+              csp_assign (s, v, !val);
+            }
+        }
+    }
+
+  // Interior unknowns can be on if some solution leaves the interior a mine,
+  // and off if some solution leaves the interior a clear tile.
+  if (consis && mine_target > -1 && csp->ninterior > 0)
+    {
+      int *scope = csp->comp_vars;
+      bool can_on = min_mines < hi;
+      bool can_off = max_mines > lo;
+      if (!can_on)
+        {
+          searches++;
+          can_on = csp_find (s, scope, csp->nfrontier, lo, hi - 1, seen, NULL);
+        }
+      if (!can_off)
+        {
+          searches++;
+          can_off = csp_find (s, scope, csp->nfrontier, lo + 1, hi, seen,
+                              NULL);
+        }
+      for (i = 0; i < csp->ninterior; i++)
+        if (can_on != can_off)
+          forced[csp->interior[i]] = can_on;
+    }
+
+  // Print the map of forced unknowns.
+  if (print >= PRINT_BASIC)
+    {
+      int forced_on = 0;
+      int forced_off = 0;
+      for (i = 0; i < csp->nvars; i++)
+        {
+          int row = csp->vars[i].row;
+          int col = csp->vars[i].col;
+          if (forced[i] == 1)
+            {
+              grid[row][col] = MINE_ON;
+              forced_on++;
+            }
+          else if (forced[i] == 0)
+            {
+              grid[row][col] = MINE_OFF;
+              forced_off++;
+            }
+          else
+            grid[row][col] = UNKNOWN;
+        }
+      if (consis)
+        {
+          board_print (grid);
+          printf ("Forced mines: %d\n", forced_on);
+          printf ("Forced clear: %d\n", forced_off);
+          printf ("Undetermined: %d\n", csp->nvars - forced_on - forced_off);
+        }
+      else
+        printf ("No solution.\n");
+      printf ("Searches: %d\n", searches);
+    }
+
+  free (seen);
+  free (forced);
+  csp_search_free (s);
+  csp_free (csp);
+}
+
+/* Fix the unknowns of GRID that the constraints pin to one state by
+   Gaussian elimination, as eliminate_system () finds them, for each
+   frontier component, or with a mine target, for all the unknowns at once
+   if there are no more than ELIM_VARS. Fixing some can pin others, so the
+   constraints are built and eliminated again, with -r after pre-resolving
+   around the tiles fixed, until nothing more is fixed, or UNSAT is set for
+   a numbered tile pre-resolving leaves no way to meet. Returns the unknowns
+   fixed. */
+static int eliminate_grid (int **grid, bool *unsat)
+{
+  struct ind *ind = (struct ind *) malloc ((ntiles + 1) * sizeof *ind);
+  int total = 0;
+  int fixed = 1;
+  int i, j, c;
+
+  // Only the search's own forcing counts in the statistics.
+  long long forced = thr_stats[thread_num].forced;
+
+  while (fixed && !*unsat)
+    {
+      int n = find_unknowns (grid, ind);
+      struct csp *csp = csp_build (grid, ind, n);
+      signed char *val = (signed char *) malloc (n + 1);
+      int *col_of = (int *) malloc ((n + 1) * sizeof (int));
+      memset (val, -1, n + 1);
+      for (i = 0; i < n; i++)
+        col_of[i] = -1;
+
+      // The mine target counts the mines given too.
+      int need = -1;
+      if (mine_target > -1)
+        {
+          need = mine_target;
+          for (i = 1; i < nrows - 1; i++)
+            for (j = 1; j < ncols - 1; j++)
+              need -= is_mine (grid[i][j]);
+        }
+
+      if (csp->unsat)
+        ;
+      else if (need >= 0 && n <= ELIM_VARS)
+        {
+          int *all = (int *) malloc ((n + 1) * sizeof (int));
+          for (i = 0; i < n; i++)
+            all[i] = i;
+          eliminate_system (csp, all, n, need, col_of, val);
+          free (all);
+        }
+      else
+        for (c = 0; c < csp->ncomps; c++)
+          eliminate_system (csp, csp->comp_vars + csp->comp_start[c],
+                            csp->comp_start[c+1] - csp->comp_start[c], -1,
+                            col_of, val);
+
+      fixed = 0;
+      for (i = 0; i < n; i++)
+        if (val[i] >= 0)
+          {
+            grid[ind[i].row][ind[i].col] = val[i] ? force_on (-1)
+              : force_off (-1);
+            fixed++;
+          }
+      if (preresolve)
+        for (i = 0; i < n && !*unsat; i++)
+          if (val[i] >= 0 && resolve_around (grid, ind[i].row, ind[i].col) < 0)
+            *unsat = true;
+      total += fixed;
+
+      free (val);
+      free (col_of);
+      csp_free (csp);
+    }
+
+  thr_stats[thread_num].forced = forced;
+  free (ind);
+  return total;
+}
+
+/* Find the states that the constraints of CSP over the NV variables VARS,
+   and with NEED of at least 0, the equation that NEED mines are among
+   them, leave only one of, into VAL. The constraints are reduced by
+   Gaussian elimination, in integers, each row kept divided by the gcd of
+   its coefficients. A variable is then pinned by a row if its other
+   variables can't make up the sum without it, or with it. Nothing is
+   pinned if the rows contradict each other, nor if the coefficients grow
+   past ELIM_COEF or VARS past ELIM_VARS. COL_OF is scratch for every
+   variable of CSP, at -1, and left so. */
+static void eliminate_system (struct csp *csp, int *vars, int nv, int need,
+                              int *col_of, signed char *val)
+{
+  if (nv > ELIM_VARS)
+    return;
+  int *start = csp->var_cons_start;
+  int w = nv + 1;
+  int ncons = 0;
+  int i, j, r;
+
+  // Take each constraint on VARS once, from its first variable.
+  for (j = 0; j < nv; j++)
+    {
+      col_of[vars[j]] = j;
+      for (i = start[vars[j]]; i < start[vars[j]+1]; i++)
+        ncons += csp->cons[csp->var_cons[i]].vars[0] == vars[j];
+    }
+  int *cons = (int *) malloc ((ncons + 1) * sizeof (int));
+  ncons = 0;
+  for (j = 0; j < nv; j++)
+    for (i = start[vars[j]]; i < start[vars[j]+1]; i++)
+      if (csp->cons[csp->var_cons[i]].vars[0] == vars[j])
+        cons[ncons++] = csp->var_cons[i];
+
+  // A row of coefficients, then the sum, for each equation.
+  int nr = ncons + (need >= 0);
+  long long *a = (long long *) calloc ((size_t) nr * w, sizeof (long long));
+  signed char *sure = (signed char *) malloc (nv + 1);
+  bool ok = true;
+  for (r = 0; r < ncons; r++)
+    {
+      struct constraint *con = &csp->cons[cons[r]];
+      for (j = 0; j < con->nvars; j++)
+        a[r * w + col_of[con->vars[j]]] = 1;
+      a[r * w + nv] = con->need;
+    }
+  if (need >= 0)
+    {
+      for (j = 0; j < nv; j++)
+        a[r * w + j] = 1;
+      a[r * w + nv] = need;
+    }
+
+  // Reduce the rows, clearing each pivot's column in the rows above it as
+  // well as below.
+  int rank = 0;
+  int col;
+  for (col = 0; col < nv && rank < nr && ok; col++)
+    {
+      int p = rank;
+      while (p < nr && !a[p * w + col])
+        p++;
+      if (p == nr)
+        continue;
+      long long *piv = &a[rank * w];
+      if (p != rank)
+        for (j = 0; j < w; j++)
+          {
+            long long t = piv[j];
+            piv[j] = a[p * w + j];
+            a[p * w + j] = t;
+          }
+      for (r = 0; r < nr && ok; r++)
+        {
+          long long *row = &a[r * w];
+          if (r == rank || !row[col])
+            continue;
+          long long f = row[col];
+          long long g = piv[col];
+          long long d = 0;
+          for (j = 0; j < w; j++)
+            {
+              row[j] = g * row[j] - f * piv[j];
+              if (row[j] > ELIM_COEF || row[j] < -ELIM_COEF)
+                ok = false;
+              long long x = row[j] < 0 ? -row[j] : row[j];
+              while (x)
+                {
+                  long long t = d % x;
+                  d = x;
+                  x = t;
+                }
+            }
+          if (d > 1)
+            for (j = 0; j < w; j++)
+              row[j] /= d;
+        }
+      rank++;
+    }
+
+  // Pin what the bounds of each row leave no choice in.
+  memset (sure, -1, nv + 1);
+  for (r = 0; r < nr && ok; r++)
+    {
+      long long *row = &a[r * w];
+      long long lo = 0;
+      long long hi = 0;
+      for (j = 0; j < nv; j++)
+        if (row[j] < 0)
+          lo += row[j];
+        else
+          hi += row[j];
+      long long b = row[nv];
+      if (b < lo || b > hi)
+        ok = false;
+      for (j = 0; j < nv && ok; j++)
+        {
+          int x = -1;
+          if (!row[j])
+            continue;
+          if (row[j] > 0 ? lo + row[j] > b : hi + row[j] < b)
+            x = 0;
+          if (row[j] > 0 ? hi - row[j] < b : lo - row[j] > b)
+            x = x == 0 ? 2 : 1;
+          if (x < 0)
+            continue;
+          if (x == 2 || (sure[j] >= 0 && sure[j] != x))
+            ok = false;
+          sure[j] = x;
+        }
+    }
+
+  // Keep nothing unless the original constraints still hold, so that
+  // a grid with no solution is left for the search to find so.
+  for (i = 0; i < ncons && ok; i++)
+    {
+      struct constraint *con = &csp->cons[cons[i]];
+      int mines = 0;
+      int open = 0;
+      for (j = 0; j < con->nvars; j++)
+        {
+          int x = sure[col_of[con->vars[j]]];
+          mines += x == 1;
+          open += x < 0;
+        }
+      ok = mines <= con->need && con->need <= mines + open;
+    }
+  for (j = 0; j < nv; j++)
+    {
+      if (ok && sure[j] >= 0)
+        val[vars[j]] = sure[j];
+      col_of[vars[j]] = -1;
+    }
+
+  free (cons);
+  free (a);
+  free (sure);
+}
+
+
+
+/*****************************************************************************
+ *
+ *  Counting functions.
+ *
+ ****************************************************************************/
+
+/* Hash of a residual key. */
+static inline unsigned int key_hash (const unsigned char *key, int len)
+{
+  unsigned int h = 2166136261u;
+  int i;
+  for (i = 0; i < len; i++)
+    h = (h ^ key[i]) * 16777619u;
+  return h;
+}
+
+/* Build the decision diagram of the N variables VARS, in that order. Every
+   constraint on them must lie within them. LEVEL is scratch space, one int
+   per variable. If LIMIT is not -1, only assignments of exactly LIMIT mines
+   are kept.
+
+   The constraints open between levels L-1 and L are the ones with variables
+   on both sides. The mines each of them still needs make up the key of a
+   node at level L, followed by the mines placed so far if there is a limit,
+   and partial assignments with equal keys share a node. Levels are built top
+   down, so only two levels of keys are kept at a time. Returns NULL if the
+   diagram grows past DD_MAX_NODES. */
+static struct dd * dd_build (struct csp *csp, int *vars, int n, int *level,
+                             bool by_mines, int limit)
+{
+  int extra = limit >= 0 ? sizeof (int) : 0;
+  int i, j, k;
+  for (i = 0; i < n; i++)
+    level[vars[i]] = i;
+
+  // List the component's constraints in order of the first level they
+  // cover, along with the last level they cover.
+  int ncons = 0;
+  for (i = 0; i < n; i++)
+    ncons += csp->var_cons_start[vars[i]+1] - csp->var_cons_start[vars[i]];
+  int *cons = (int *) malloc ((ncons + 1) * sizeof (int));
+  int *first = (int *) malloc ((ncons + 1) * sizeof (int));
+  int *last = (int *) malloc ((ncons + 1) * sizeof (int));
+  ncons = 0;
+  for (i = 0; i < n; i++)
+    for (j = csp->var_cons_start[vars[i]];
+         j < csp->var_cons_start[vars[i]+1]; j++)
+      {
+        struct constraint *con = &csp->cons[csp->var_cons[j]];
+        int lo = n;
+        int hi = -1;
+        for (k = 0; k < con->nvars; k++)
+          {
+            int lvl = level[con->vars[k]];
+            lo = lvl < lo ? lvl : lo;
+            hi = lvl > hi ? lvl : hi;
+          }
+        if (lo == i)
+          {
+            first[ncons] = lo;
+            last[ncons] = hi;
+            cons[ncons++] = csp->var_cons[j];
+          }
+      }
+
+  struct dd *dd = (struct dd *) calloc (1, sizeof *dd);
+  dd->nlevels = n;
+  dd->vars = vars;
+  dd->by_mines = by_mines;
+  dd->level_start = (int *) malloc ((n + 2) * sizeof (int));
+  int nodes_cap = 1024;
+  dd->child = (int (*)[2]) malloc (nodes_cap * sizeof *dd->child);
+
+  // How each constraint covering a level is checked, and carried over into
+  // the keys of the next level.
+  struct slot
+  {
+    int src;                  // Position in the current key, -1 if opening.
+    int need;                 // Mines needed, if opening.
+    int has_var;              // Constraint holds the level's variable.
+    int rem;                  // Variables in the constraint past the level.
+    bool keep;                // Constraint is still open past the level.
+  } *slots = (struct slot *) malloc ((ncons + 1) * sizeof *slots);
+  int *open = (int *) malloc ((ncons + 1) * sizeof (int));
+  int *next_open = (int *) malloc ((ncons + 1) * sizeof (int));
+  int width = 0;
+  int next_con = 0;
+
+  // Keys of the current and next level, and the next level's hash table.
+  size_t keys_cap = 1024;
+  size_t next_keys_cap = 1024;
+  unsigned char *keys = (unsigned char *) malloc (keys_cap);
+  unsigned char *next_keys = (unsigned char *) malloc (next_keys_cap);
+  unsigned char *key = (unsigned char *) malloc (ncons + extra + 1);
+  int table_cap = 1024;
+  int *table = (int *) malloc (table_cap * sizeof (int));
+
+  // The root has an empty key, but for the mines placed.
+  int mines = 0;
+  if (extra)
+    memcpy (keys, &mines, extra);
+  dd->level_start[0] = 0;
+  dd->nnodes = 1;
+  bool overflow = false;
+  for (i = 0; i < n && !overflow; i++)
+    {
+      // Set up the slots: open constraints first, in key order, then the
+      // constraints opening at this level.
+      int nslots = 0;
+      int next_width = 0;
+      for (j = 0; j < width + ncons; j++)
+        {
+          int p;
+          if (j < width)
+            p = open[j];
+          else if (next_con < ncons && first[next_con] == i)
+            p = next_con++;
+          else
+            break;
+
+          struct constraint *con = &csp->cons[cons[p]];
+          struct slot *slot = &slots[nslots++];
+          slot->src = j < width ? j : -1;
+          slot->need = con->need;
+          slot->has_var = 0;
+          slot->rem = 0;
+          for (k = 0; k < con->nvars; k++)
+            {
+              if (level[con->vars[k]] == i)
+                slot->has_var = 1;
+              else if (level[con->vars[k]] > i)
+                slot->rem++;
+            }
+          slot->keep = last[p] > i;
+          if (slot->keep)
+            next_open[next_width++] = p;
+        }
+
+      // Expand every node of this level.
+      int start = dd->level_start[i];
+      int end = dd->nnodes;
+      int count = 0;
+      while (table_cap < 2 * (end - start) * 2)
+        table_cap *= 2;
+      table = (int *) realloc (table, table_cap * sizeof (int));
+      memset (table, -1, table_cap * sizeof (int));
+      int u, x;
+      for (u = start; u < end && !overflow; u++)
+        for (x = 0; x < 2; x++)
+          {
+            // Check each constraint, and fill in the child's key.
+            unsigned char *parent = keys + (size_t) (u - start)
+              * (width + extra);
+            bool consis = true;
+            int len = 0;
+            if (extra)
+              {
+                memcpy (&mines, parent + width, extra);
+                mines += x;
+                consis = mines <= limit && mines + n - 1 - i >= limit;
+              }
+            for (j = 0; j < nslots && consis; j++)
+              {
+                struct slot *slot = &slots[j];
+                int need = (slot->src >= 0 ? parent[slot->src] : slot->need)
+                  - slot->has_var * x;
+                if (need < 0 || need > slot->rem)
+                  consis = false;
+                else if (slot->keep)
+                  key[len++] = need;
+              }
+            if (!consis)
+              {
+                dd->child[u][x] = -1;
+                continue;
+              }
+            if (extra)
+              {
+                memcpy (key + len, &mines, extra);
+                len += extra;
+              }
+
+            // Find the child among the nodes made so far, or make it.
+            if (2 * count >= table_cap)
+              {
+                table_cap *= 2;
+                table = (int *) realloc (table, table_cap * sizeof (int));
+                memset (table, -1, table_cap * sizeof (int));
+                for (k = 0; k < count; k++)
+                  {
+                    unsigned int h = key_hash (next_keys + (size_t) k * len,
+                                               len) & (table_cap - 1);
+                    while (table[h] >= 0)
+                      h = (h + 1) & (table_cap - 1);
+                    table[h] = k;
+                  }
+              }
+            unsigned int h = key_hash (key, len) & (table_cap - 1);
+            while (table[h] >= 0
+                   && memcmp (next_keys + (size_t) table[h] * len, key, len))
+              h = (h + 1) & (table_cap - 1);
+            if (table[h] < 0)
+              {
+                if (dd->nnodes >= DD_MAX_NODES)
+                  {
+                    overflow = true;
+                    break;
+                  }
+                if (dd->nnodes == nodes_cap)
+                  {
+                    nodes_cap *= 2;
+                    dd->child = (int (*)[2])
+                      realloc (dd->child, nodes_cap * sizeof *dd->child);
+                  }
+                if ((size_t) (count + 1) * len > next_keys_cap)
+                  {
+                    next_keys_cap = 2 * (count + 1) * (size_t) len;
+                    next_keys = (unsigned char *)
+                      realloc (next_keys, next_keys_cap);
+                  }
+                memcpy (next_keys + (size_t) count * len, key, len);
+                table[h] = count++;
+                dd->nnodes++;
+              }
+            dd->child[u][x] = end + table[h];
+          }
+
+      // Move on to the next level.
+      unsigned char *tmp = keys;
+      keys = next_keys;
+      next_keys = tmp;
+      size_t tmp_cap = keys_cap;
+      keys_cap = next_keys_cap;
+      next_keys_cap = tmp_cap;
+      int *tmp_open = open;
+      open = next_open;
+      next_open = tmp_open;
+      width = next_width;
+      dd->level_start[i+1] = end;
+    }
+  dd->level_start[n+1] = dd->nnodes;
+
+  free (cons);
+  free (first);
+  free (last);
+  free (slots);
+  free (open);
+  free (next_open);
+  free (keys);
+  free (next_keys);
+  free (key);
+  free (table);
+  if (overflow)
+    {
+      dd_free (dd);
+      return NULL;
+    }
+
+  // The terminal is the last node, if there is one.
+  dd->child = (int (*)[2])
+    realloc (dd->child, (dd->nnodes + 1) * sizeof *dd->child);
+  dd->child[dd->nnodes-1][0] = dd->child[dd->nnodes-1][1] = -1;
+  dd->count = (struct poly *) calloc (dd->nnodes, sizeof *dd->count);
+  dd->count_scale = (double *) calloc (n + 1, sizeof (double));
+  dd->pool = (double **) calloc (n + 1, sizeof (double *));
+  return dd;
+}
+
+static void dd_free (struct dd *dd)
+{
+  int i;
+  if (dd->pool)
+    for (i = 0; i <= dd->nlevels; i++)
+      free (dd->pool[i]);
+  free (dd->pool);
+  free (dd->count);
+  free (dd->count_scale);
+  free (dd->child);
+  free (dd->level_start);
+  free (dd);
+}
+
+/* Add SRC, shifted up by SHIFT mines and multiplied by MUL, into DST. DST
+   must already cover the range. */
+static inline void poly_add (struct poly *dst, struct poly *src, int shift,
+                             double mul)
+{
+  int i;
+  double *c = dst->c + src->lo + shift - dst->lo;
+  for (i = 0; i < src->len; i++)
+    c[i] += src->c[i] * mul;
+}
+
+/* Count the solutions below every node of DD, bottom up. With BY_MINES the
+   counts are kept apart by number of mines. To stay within the range of a
+   double, the counts of each level are divided by their largest, whose log
+   is added into COUNT_SCALE. */
+static void dd_count (struct dd *dd)
+{
+  int n = dd->nlevels;
+  int shift = dd->by_mines ? 1 : 0;
+  int i, u, x;
+
+  if (dd->level_start[n] < dd->level_start[n+1])
+    {
+      u = dd->level_start[n];
+      dd->pool[n] = (double *) malloc (sizeof (double));
+      dd->pool[n][0] = 1;
+      dd->count[u].lo = 0;
+      dd->count[u].len = 1;
+      dd->count[u].c = dd->pool[n];
+    }
+
+  for (i = n - 1; i >= 0; i--)
+    {
+      // Find each node's range of mines, to size the level's storage.
+      size_t size = 0;
+      for (u = dd->level_start[i]; u < dd->level_start[i+1]; u++)
+        {
+          int lo = INT_MAX;
+          int hi = INT_MIN;
+          for (x = 0; x < 2; x++)
+            {
+              int ch = dd->child[u][x];
+              if (ch < 0 || !dd->count[ch].len)
+                continue;
+              int s = x * shift;
+              lo = dd->count[ch].lo + s < lo ? dd->count[ch].lo + s : lo;
+              hi = dd->count[ch].lo + dd->count[ch].len - 1 + s > hi
+                ? dd->count[ch].lo + dd->count[ch].len - 1 + s : hi;
+            }
+          dd->count[u].lo = lo;
+          dd->count[u].len = hi >= lo ? hi - lo + 1 : 0;
+          size += dd->count[u].len;
+        }
+
+      dd->pool[i] = (double *) calloc (size + 1, sizeof (double));
+      double *c = dd->pool[i];
+      double max = 0;
+      for (u = dd->level_start[i]; u < dd->level_start[i+1]; u++)
+        {
+          dd->count[u].c = c;
+          c += dd->count[u].len;
+          for (x = 0; x < 2; x++)
+            {
+              int ch = dd->child[u][x];
+              if (ch >= 0 && dd->count[ch].len)
+                poly_add (&dd->count[u], &dd->count[ch], x * shift, 1);
+            }
+          int k;
+          for (k = 0; k < dd->count[u].len; k++)
+            max = dd->count[u].c[k] > max ? dd->count[u].c[k] : max;
+        }
+
+      dd->count_scale[i] = dd->count_scale[i+1];
+      if (max > 0)
+        {
+          double *end = c;
+          for (c = dd->pool[i]; c < end; c++)
+            *c /= max;
+          dd->count_scale[i] += log (max);
+        }
+    }
+}
+
+/* Find the probability of each variable of a counted DD being on, with the
+   solutions of the component weighed by their number of mines, by WEIGHT.
+   For a level's variable, that is the sum over the level's nodes of the
+   paths from the root to the node times the solutions below its on child.
+   Paths are counted top down, with each level divided by its largest, like
+   the counts. Writes the probabilities into PROB, by variable. */
+static void dd_marginals (struct dd *dd, struct poly *weight, double *prob)
+{
+  int n = dd->nlevels;
+  int shift = dd->by_mines ? 1 : 0;
+  int i, u, x, j, k;
+
+  // Weight of a solution with K mines.
+#define WEIGHT(K) ((K) - weight->lo >= 0 && (K) - weight->lo < weight->len \
+                   ? weight->c[(K) - weight->lo] : 0)
+
+  // Weighed total, on the root's scale.
+  struct poly *root = &dd->count[0];
+  double total = 0;
+  for (k = 0; k < root->len; k++)
+    total += root->c[k] * WEIGHT (root->lo + k);
+
+  // Range of mines on the paths to each node.
+  int *lo = (int *) malloc (dd->nnodes * sizeof (int));
+  int *hi = (int *) malloc (dd->nnodes * sizeof (int));
+  for (u = 0; u < dd->nnodes; u++)
+    {
+      lo[u] = INT_MAX;
+      hi[u] = INT_MIN;
+    }
+  lo[0] = hi[0] = 0;
+  for (u = 0; u < dd->level_start[n]; u++)
+    if (dd->count[u].len && lo[u] <= hi[u])
+      for (x = 0; x < 2; x++)
+        {
+          int ch = dd->child[u][x];
+          if (ch < 0 || !dd->count[ch].len)
+            continue;
+          lo[ch] = lo[u] + x * shift < lo[ch] ? lo[u] + x * shift : lo[ch];
+          hi[ch] = hi[u] + x * shift > hi[ch] ? hi[u] + x * shift : hi[ch];
+        }
+
+  // Paths of the current and next level, by mines.
+  double **paths = (double **) calloc (dd->nnodes, sizeof (double *));
+  double *pool = (double *) calloc (1, sizeof (double));
+  double *next_pool = NULL;
+  double scale = 0;
+  paths[0] = pool;
+  paths[0][0] = 1;
+  for (i = 0; i < n; i++)
+    {
+      size_t size = 0;
+      for (u = dd->level_start[i+1]; u < dd->level_start[i+2]; u++)
+        if (lo[u] <= hi[u])
+          size += hi[u] - lo[u] + 1;
+      next_pool = (double *) calloc (size + 1, sizeof (double));
+      double *c = next_pool;
+      for (u = dd->level_start[i+1]; u < dd->level_start[i+2]; u++)
+        if (lo[u] <= hi[u])
+          {
+            paths[u] = c;
+            c += hi[u] - lo[u] + 1;
+          }
+
+      double on = 0;
+      for (u = dd->level_start[i]; u < dd->level_start[i+1]; u++)
+        {
+          if (!paths[u])
+            continue;
+          int len = hi[u] - lo[u] + 1;
+          for (x = 0; x < 2; x++)
+            {
+              int ch = dd->child[u][x];
+              if (ch < 0 || !dd->count[ch].len)
+                continue;
+              double *to = paths[ch] + lo[u] + x * shift - lo[ch];
+              for (j = 0; j < len; j++)
+                to[j] += paths[u][j];
+            }
+
+          // Weighed solutions through the on child.
+          int ch = dd->child[u][1];
+          if (ch < 0 || !dd->count[ch].len)
+            continue;
+          struct poly *below = &dd->count[ch];
+          for (j = 0; j < len; j++)
+            if (paths[u][j] != 0)
+              {
+                double sum = 0;
+                for (k = 0; k < below->len; k++)
+                  sum += below->c[k]
+                    * WEIGHT (lo[u] + j + shift + below->lo + k);
+                on += paths[u][j] * sum;
+              }
+        }
+
+      // Put the sum on the root's scale. The scales can be far apart, so
+      // combine them as logs.
+      prob[dd->vars[i]] = (on > 0 && total > 0)
+        ? exp (log (on) - log (total) + scale + dd->count_scale[i+1]
+               - dd->count_scale[0]) : 0;
+
+      double max = 0;
+      for (c = next_pool; c < next_pool + size; c++)
+        max = *c > max ? *c : max;
+      if (max > 0)
+        {
+          for (c = next_pool; c < next_pool + size; c++)
+            *c /= max;
+          scale += log (max);
+        }
+      free (pool);
+      pool = next_pool;
+    }
+#undef WEIGHT
+
+  free (pool);
+  free (paths);
+  free (lo);
+  free (hi);
+}
+
+/* Multiply A by B into a new polynomial, divided by its largest. */
+static struct poly poly_mul (struct poly *a, struct poly *b)
+{
+  struct poly p;
+  p.lo = a->lo + b->lo;
+  p.len = (a->len && b->len) ? a->len + b->len - 1 : 0;
+  p.c = (double *) calloc (p.len + 1, sizeof (double));
+  int i, j;
+  double max = 0;
+  for (i = 0; i < a->len; i++)
+    for (j = 0; j < b->len; j++)
+      p.c[i+j] += a->c[i] * b->c[j];
+  for (i = 0; i < p.len; i++)
+    max = p.c[i] > max ? p.c[i] : max;
+  if (max > 0)
+    for (i = 0; i < p.len; i++)
+      p.c[i] /= max;
+  return p;
+}
+
+/* Product of the component counts COUNTS[A] to COUNTS[B-1]. */
+static struct poly poly_product (struct poly *counts, int a, int b)
+{
+  if (b - a == 1)
+    {
+      struct poly one = {0, 1, NULL};
+      double c = 1;
+      one.c = &c;
+      return poly_mul (&counts[a], &one);
+    }
+  int mid = (a + b) / 2;
+  struct poly left = poly_product (counts, a, mid);
+  struct poly right = poly_product (counts, mid, b);
+  struct poly p = poly_mul (&left, &right);
+  free (left.c);
+  free (right.c);
+  return p;
+}
+
+/* Weigh the mine counts of components A to B-1. WEIGHT[K] is the weight of
+   a solution that places K mines among these components, having summed over
+   all the other components. Splitting in halves, each half's weight is WEIGHT
+   summed over the other half's counts. Each component's weights end up in
+   WEIGHTS, over the range of its counts. */
+static void weigh_components (struct poly *counts, struct poly *weights,
+                              int a, int b, struct poly *weight)
+{
+  if (b - a == 1)
+    {
+      struct poly *w = &weights[a];
+      w->lo = counts[a].lo;
+      w->len = counts[a].len;
+      w->c = (double *) calloc (w->len + 1, sizeof (double));
+      int k;
+      for (k = 0; k < w->len; k++)
+        if (w->lo + k - weight->lo >= 0 && w->lo + k - weight->lo < weight->len)
+          w->c[k] = weight->c[w->lo + k - weight->lo];
+      return;
+    }
+
+  int mid = (a + b) / 2;
+  int half;
+  for (half = 0; half < 2; half++)
+    {
+      struct poly mine = half ? poly_product (counts, mid, b)
+        : poly_product (counts, a, mid);
+      struct poly other = half ? poly_product (counts, a, mid)
+        : poly_product (counts, mid, b);
+      struct poly w;
+      w.lo = mine.lo;
+      w.len = mine.len;
+      w.c = (double *) calloc (w.len + 1, sizeof (double));
+      int j, k;
+      double max = 0;
+      for (j = 0; j < w.len; j++)
+        {
+          for (k = 0; k < other.len; k++)
+            {
+              int mines = w.lo + j + other.lo + k - weight->lo;
+              if (mines >= 0 && mines < weight->len)
+                w.c[j] += other.c[k] * weight->c[mines];
+            }
+          max = w.c[j] > max ? w.c[j] : max;
+        }
+      if (max > 0)
+        for (j = 0; j < w.len; j++)
+          w.c[j] /= max;
+
+      if (half)
+        weigh_components (counts, weights, mid, b, &w);
+      else
+        weigh_components (counts, weights, a, mid, &w);
+      free (w.c);
+      free (mine.c);
+      free (other.c);
+    }
+}
+
+/* Build and count the decision diagram of each component of CSP that has
+   none in DDS yet. Returns the number built. */
+static int csp_diagrams (struct csp *csp, struct dd **dds)
+{
+  bool by_mines = mine_target > -1;
+  int *level = (int *) malloc ((csp->nvars + 1) * sizeof (int));
+  int built = 0;
+  int c;
+  for (c = 0; c < csp->ncomps; c++)
+    {
+      if (dds[c])
+        continue;
+      dds[c] = dd_build (csp, csp->comp_vars + csp->comp_start[c],
+                         csp->comp_start[c+1] - csp->comp_start[c], level,
+                         by_mines, -1);
+      if (!dds[c])
+        {
+          fprintf (stderr, "Component too wide to count.\n");
+          exit (1);
+        }
+      dd_count (dds[c]);
+      built++;
+    }
+  free (level);
+  return built;
+}
+
+/* Find the probability that each unknown is a mine, over all solutions
+   counted with equal weight, from the counted decision diagrams DDS of the
+   components. Without a mine target, components are independent, and
+   interior unknowns are even odds. With one, a component's solutions are
+   weighed by the ways the other components and the interior can make up the
+   rest of the mines; an interior holding R of the mines can do so in
+   C(NINTERIOR, R) ways. Returns NULL if there is no solution. */
+static double * csp_probabilities (struct csp *csp, struct dd **dds)
+{
+  bool by_mines = mine_target > -1;
+  double *prob = (double *) malloc ((csp->nvars + 1) * sizeof (double));
+  struct poly *counts = (struct poly *)
+    calloc (csp->ncomps + 1, sizeof *counts);
+  bool consis = !csp->unsat && mine_target >= -1;
+  int c, i, k;
+
+  for (c = 0; c < csp->ncomps && consis; c++)
+    {
+      counts[c] = dds[c]->count[0];
+      if (!counts[c].len)
+        consis = false;
+    }
+
+  // Weigh each way of splitting the mines between the frontier and the
+  // interior, as the log of C(NINTERIOR, MINE_TARGET - K) for K frontier
+  // mines, then divide by the largest.
+  struct poly interior = {0, 1, NULL};
+  struct poly *weights = (struct poly *)
+    calloc (csp->ncomps + 1, sizeof *weights);
+  double interior_prob = 0.5;
+  if (consis && by_mines)
+    {
+      interior.len = csp->nfrontier + 1;
+      interior.c = (double *) malloc ((interior.len + 1) * sizeof (double));
+      double max = -HUGE_VAL;
+      for (k = 0; k < interior.len; k++)
+        {
+          int rest = mine_target - k;
+          interior.c[k] = (rest < 0 || rest > csp->ninterior) ? -HUGE_VAL
+            : lgamma (csp->ninterior + 1.0) - lgamma (rest + 1.0)
+            - lgamma (csp->ninterior - rest + 1.0);
+          max = interior.c[k] > max ? interior.c[k] : max;
+        }
+      if (max == -HUGE_VAL)
+        consis = false;
+      for (k = 0; k < interior.len; k++)
+        interior.c[k] = exp (interior.c[k] - max);
+
+      if (consis && csp->ncomps > 0)
+        weigh_components (counts, weights, 0, csp->ncomps, &interior);
+
+      // Interior unknowns hold the mines the frontier leaves over.
+      struct poly all = {0, 1, NULL};
+      double one = 1;
+      all.c = &one;
+      if (csp->ncomps > 0)
+        all = poly_product (counts, 0, csp->ncomps);
+      double total = 0;
+      double on = 0;
+      for (k = 0; k < all.len; k++)
+        {
+          int mines = all.lo + k;
+          if (mines >= interior.len)
+            continue;
+          total += all.c[k] * interior.c[mines];
+          if (csp->ninterior)
+            on += all.c[k] * interior.c[mines]
+              * (mine_target - mines) / csp->ninterior;
+        }
+      if (total <= 0)
+        consis = false;
+      else
+        interior_prob = on / total;
+      if (csp->ncomps > 0)
+        free (all.c);
+    }
+
+  for (i = 0; i < csp->ninterior; i++)
+    prob[csp->interior[i]] = interior_prob;
+
+  struct poly even = {0, 1, NULL};
+  double one = 1;
+  even.c = &one;
+  for (c = 0; c < csp->ncomps && consis; c++)
+    dd_marginals (dds[c], by_mines ? &weights[c] : &even, prob);
+
+  for (c = 0; c < csp->ncomps; c++)
+    free (weights[c].c);
+  free (interior.c);
+  free (weights);
+  free (counts);
+  if (!consis)
+    {
+      free (prob);
+      return NULL;
+    }
+  return prob;
+}
+
+/* Print the probability PROB of each variable of CSP being a mine over
+   GRID, or write it to PROB_FILE as a binary array: the number of rows and
+   of columns as ints, then a double for each tile, row by row. */
+static void prob_print (int **grid, struct csp *csp, double *prob)
+{
+  int i, j;
+
+  if (!prob)
+    {
+      if (print >= PRINT_BASIC)
+        printf ("No solution.\n");
+      return;
+    }
+
+  // Lay the probabilities out over the grid.
+  double *map = (double *) malloc (ntiles * sizeof (double));
+  for (i = 0; i < nrows; i++)
+    for (j = 0; j < ncols; j++)
+      map[i * ncols + j] = is_mine (grid[i][j]) ? 1 : 0;
+  for (i = 0; i < csp->nvars; i++)
+    map[csp->vars[i].row * ncols + csp->vars[i].col] = prob[i];
+
+  if (prob_file)
+    {
+      FILE *fh = fopen (prob_file, "wb");
+      if (!fh)
+        {
+          fprintf (stderr, "Could not open %s.\n", prob_file);
+          exit (1);
+        }
+      int dims[2] = {nrows - 2, ncols - 2};
+      fwrite (dims, sizeof (int), 2, fh);
+      for (i = 1; i < nrows - 1; i++)
+        fwrite (&map[i * ncols + 1], sizeof (double), ncols - 2, fh);
+      fclose (fh);
+    }
+  else if (print >= PRINT_BASIC)
+    {
+      // Unknowns are printed as a probability, other tiles as usual.
+      for (i = 1; i < nrows - 1; i++)
+        {
+          for (j = 1; j < ncols - 1; j++)
+            {
+              if (grid[i][j] == UNKNOWN)
+                printf (" %4.2f", map[i * ncols + j]);
+              else if (0 <= grid[i][j] && grid[i][j] < UNKNOWN)
+                printf ("    %c", TILE_UNMAP(grid[i][j]));
+              else
+                printf ("    %c", is_mine (grid[i][j])
+                        ? MINE_ON_CHAR : MINE_OFF_CHAR);
+            }
+          printf ("\n");
+        }
+      printf ("\n\n");
+    }
+
+  free (map);
+}
+
+/* Print the probability that each tile is a mine. */
+static void prob_map (int **grid)
+{
+  struct csp *csp = csp_build (grid, thr_data[0].bufs.ind, total_unknowns);
+  struct dd **dds = (struct dd **) calloc (csp->ncomps + 1, sizeof *dds);
+  int c;
+
+  if (!csp->unsat)
+    csp_diagrams (csp, dds);
+  double *prob = csp_probabilities (csp, dds);
+  prob_print (grid, csp, prob);
+
+  for (c = 0; c < csp->ncomps; c++)
+    if (dds[c])
+      dd_free (dds[c]);
+  free (dds);
+  free (prob);
+  csp_free (csp);
+}
+
+
+
+/* Key of component C of CSP, for finding its diagram among those kept by
+   interactive mode. Sets LEN to its length. A constraint is listed at its
+   first variable, in variable order. */
+static int * comp_key (struct csp *csp, int c, int *len)
+{
+  int *vars = csp->comp_vars + csp->comp_start[c];
+  int n = csp->comp_start[c+1] - csp->comp_start[c];
+  int ncons = 0;
+  int i, j, k;
+  for (i = 0; i < n; i++)
+    ncons += csp->var_cons_start[vars[i]+1] - csp->var_cons_start[vars[i]];
+
+  int *key = (int *) malloc ((1 + 2 * n + 3 * ncons) * sizeof (int));
+  *len = 0;
+  key[(*len)++] = n;
+  for (i = 0; i < n; i++)
+    {
+      key[(*len)++] = csp->vars[vars[i]].row;
+      key[(*len)++] = csp->vars[vars[i]].col;
+    }
+  for (i = 0; i < n; i++)
+    for (j = csp->var_cons_start[vars[i]];
+         j < csp->var_cons_start[vars[i]+1]; j++)
+      {
+        struct constraint *con = &csp->cons[csp->var_cons[j]];
+        bool first = true;
+        for (k = 0; k < con->nvars; k++)
+          if (con->vars[k] < vars[i])
+            first = false;
+        if (!first)
+          continue;
+        key[(*len)++] = con->index.row;
+        key[(*len)++] = con->index.col;
+        key[(*len)++] = con->need;
+      }
+  return key;
+}
+
+/* Apply a move of interactive mode: TILE revealed at ROW, COL of the board,
+   counting from 0. A number may be revealed on an unknown or a tile known to
+   be clear, a mine or a clear tile on an unknown or a tile already known to
+   be one. Returns false if the move isn't valid. */
+static bool apply_move (int **grid, int row, int col, char tile)
+{
+  row++;
+  col++;
+  if (row < 1 || row >= nrows - 1 || col < 1 || col >= ncols - 1)
+    return false;
+
+  int placed = 0;
+  if (tile == MINE_ON_CHAR || tile == MINE_OFF_CHAR)
+    {
+      if (grid[row][col] != UNKNOWN)
+        return (grid[row][col] < 0 || grid[row][col] > UNKNOWN)
+          && is_mine (grid[row][col]) == (tile == MINE_ON_CHAR);
+      placed = tile == MINE_ON_CHAR;
+      grid[row][col] = placed ? force_on (-1) : force_off (-1);
+    }
+  else if ('0' <= tile && tile <= '8')
+    {
+      if (grid[row][col] != UNKNOWN && grid[row][col] >= 0)
+        return false;
+      grid[row][col] = TILE_MAP(tile);
+    }
+  else
+    return false;
+
+  // A move pre-resolving finds no way to meet leaves no solution, marked
+  // as in preprocess_grid ().
+  int around = preresolve ? resolve_around (grid, row, col) : 0;
+  if (around < 0)
+    {
+      mine_target = -2;
+      return true;
+    }
+  placed += around;
+
+  // Mines placed count against the target, as in preprocess_grid ().
+  if (mine_target > -1)
+    {
+      mine_target -= placed;
+      if (mine_target < 0)
+        mine_target = -2;
+    }
+  return true;
+}
+
+/* Print the probabilities of GRID, then take moves from standard input and
+   print them again after each, until the input ends. The constraint system
+   is rebuilt after each move, which is a scan of the grid, but the decision
+   diagrams of components a move leaves as they were are kept: only the
+   components it changes, splits or joins are counted again. */
+static void interactive_solve (int **grid)
+{
+  struct ind *ind = thr_data[0].bufs.ind;
+  struct dd_cache *cache = NULL;
+  int ncache = 0;
+  char line[INBUF_SIZ];
+  int c, i;
+
+  while (true)
+    {
+      struct timeval move_start, move_end;
+      if (print >= PRINT_MIN)
+        gettimeofday (&move_start, NULL);
+
+      // Rebuild the constraint system, and take each component's diagram
+      // from the cache if it's there. The table holds cache entries by
+      // hash.
+      total_unknowns = find_unknowns (grid, ind);
+      struct csp *csp = csp_build (grid, ind, total_unknowns);
+      struct dd_cache *next = (struct dd_cache *)
+        calloc (csp->ncomps + 1, sizeof *next);
+      struct dd **dds = (struct dd **) calloc (csp->ncomps + 1, sizeof *dds);
+      int table_cap = 16;
+      while (table_cap < 2 * ncache)
+        table_cap *= 2;
+      int *table = (int *) malloc (table_cap * sizeof (int));
+      memset (table, -1, table_cap * sizeof (int));
+      for (i = 0; i < ncache; i++)
+        {
+          unsigned int h = cache[i].hash & (table_cap - 1);
+          while (table[h] >= 0)
+            h = (h + 1) & (table_cap - 1);
+          table[h] = i;
+        }
+
+      for (c = 0; c < csp->ncomps; c++)
+        {
+          struct dd_cache *entry = &next[c];
+          entry->key = comp_key (csp, c, &entry->len);
+          entry->hash = key_hash ((unsigned char *) entry->key,
+                                  entry->len * sizeof (int));
+          unsigned int h = entry->hash & (table_cap - 1);
+          for (; table[h] >= 0; h = (h + 1) & (table_cap - 1))
+            {
+              struct dd_cache *old = &cache[table[h]];
+              if (old->dd && old->hash == entry->hash
+                  && old->len == entry->len
+                  && !memcmp (old->key, entry->key,
+                              entry->len * sizeof (int)))
+                {
+                  // Same variables in the same order, so the levels carry
+                  // over.
+                  dds[c] = old->dd;
+                  dds[c]->vars = csp->comp_vars + csp->comp_start[c];
+                  old->dd = NULL;
+                  break;
+                }
+            }
+        }
+      int built = csp->unsat ? 0 : csp_diagrams (csp, dds);
+
+      // Keep this move's diagrams, and drop the ones no longer used.
+      for (i = 0; i < ncache; i++)
+        {
+          free (cache[i].key);
+          if (cache[i].dd)
+            dd_free (cache[i].dd);
+        }
+      free (cache);
+      for (c = 0; c < csp->ncomps; c++)
+        next[c].dd = dds[c];
+      cache = next;
+      ncache = csp->ncomps;
+
+      double *prob = csp_probabilities (csp, dds);
+      prob_print (grid, csp, prob);
+      if (print >= PRINT_MIN)
+        {
+          gettimeofday (&move_end, NULL);
+          printf ("Move time: %f ms, %d of %d components counted\n",
+                  (move_end.tv_sec - move_start.tv_sec) * 1000.0
+                  + (move_end.tv_usec - move_start.tv_usec) / 1000.0,
+                  built, csp->ncomps);
+        }
+      fflush (stdout);
+
+      free (prob);
+      free (dds);
+      free (table);
+      csp_free (csp);
+
+      // Read moves until a valid one.
+      bool moved = false;
+      while (!moved && fgets (line, INBUF_SIZ, stdin))
+        {
+          int row, col;
+          char tile;
+          moved = sscanf (line, "%d %d %c", &row, &col, &tile) == 3
+            && apply_move (grid, row, col, tile);
+          if (!moved)
+            fprintf (stderr, "Invalid move.\n");
+        }
+      if (!moved)
+        break;
+    }
+
+  for (i = 0; i < ncache; i++)
+    {
+      free (cache[i].key);
+      if (cache[i].dd)
+        dd_free (cache[i].dd);
+    }
+  free (cache);
+}
+
+/* Random number in [0, 1), from the xorshift64* generator in STATE. */
+static inline double rng_uniform (uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return ((*state * 2685821657736338717ULL) >> 11)
+    * (1.0 / 9007199254740992.0);
+}
+
+/* Random number in [0, 1), from RNG_STATE. */
+static double rng_double ()
+{
+  return rng_uniform (&rng_state);
+}
+
+/* Coefficient of POLY for K mines. */
+static inline double poly_coef (struct poly *poly, int k)
+{
+  return (k >= poly->lo && k < poly->lo + poly->len)
+    ? poly->c[k - poly->lo] : 0;
+}
+
+/* Walk a counted DD from the root, choosing each child with probability
+   proportional to the solutions below it, and set the tiles of GRID to
+   match. With BY_MINES, only solutions with MINES mines are drawn from.
+   Both children are on the same level, and so on the same scale. */
+static void dd_sample (struct dd *dd, struct csp *csp, int mines, int **grid)
+{
+  int u = 0;
+  int i;
+  for (i = 0; i < dd->nlevels; i++)
+    {
+      double weight[2];
+      int x;
+      for (x = 0; x < 2; x++)
+        {
+          int ch = dd->child[u][x];
+          if (ch < 0 || !dd->count[ch].len)
+            weight[x] = 0;
+          else if (dd->by_mines)
+            weight[x] = poly_coef (&dd->count[ch], mines - x);
+          else
+            weight[x] = dd->count[ch].c[0];
+        }
+      x = rng_double () * (weight[0] + weight[1]) >= weight[0];
+      mines -= x;
+      u = dd->child[u][x];
+
+      struct ind ind = csp->vars[dd->vars[i]];
+      grid[ind.row][ind.col] = x ? MINE_ON : MINE_OFF;
+    }
+}
+
+/* Draw SAMPLES solutions uniformly at random, and print them. Components are
+   independent unless there is a mine target. With one, the mines are dealt
+   out one component at a time: a component gets K mines with probability
+   proportional to its solutions with K mines, times the ways the components
+   after it and the interior can hold the mines left over. Each component
+   then draws a solution with its K mines from its decision diagram, and the
+   interior's mines go to random interior unknowns. */
+static void sample_solutions (int **grid)
+{
+  struct csp *csp = csp_build (grid, thr_data[0].bufs.ind, total_unknowns);
+  bool by_mines = mine_target > -1;
+  int *level = (int *) malloc ((csp->nvars + 1) * sizeof (int));
+  struct dd **dds = (struct dd **) calloc (csp->ncomps + 1, sizeof *dds);
+  bool consis = !csp->unsat && mine_target >= -1;
+  int c, i, j, k;
+
+  for (c = 0; c < csp->ncomps && consis; c++)
+    {
+      dds[c] = dd_build (csp, csp->comp_vars + csp->comp_start[c],
+                         csp->comp_start[c+1] - csp->comp_start[c], level,
+                         by_mines, -1);
+      if (!dds[c])
+        {
+          fprintf (stderr, "Component too wide to count.\n");
+          exit (1);
+        }
+      dd_count (dds[c]);
+      if (!dds[c]->count[0].len)
+        consis = false;
+    }
+
+  // Ways for components C onwards and the interior to hold J mines, for J up
+  // to MINE_TARGET, each divided by its largest.
+  double **rest = NULL;
+  int target = mine_target;
+  if (consis && by_mines)
+    {
+      rest = (double **) calloc (csp->ncomps + 1, sizeof (double *));
+      for (c = 0; c <= csp->ncomps; c++)
+        rest[c] = (double *) calloc (target + 1, sizeof (double));
+
+      double max = -HUGE_VAL;
+      for (j = 0; j <= target && j <= csp->ninterior; j++)
+        {
+          rest[csp->ncomps][j] = lgamma (csp->ninterior + 1.0)
+            - lgamma (j + 1.0) - lgamma (csp->ninterior - j + 1.0);
+          max = rest[csp->ncomps][j] > max ? rest[csp->ncomps][j] : max;
+        }
+      for (j = 0; j <= target && j <= csp->ninterior; j++)
+        rest[csp->ncomps][j] = exp (rest[csp->ncomps][j] - max);
+
+      for (c = csp->ncomps - 1; c >= 0; c--)
+        {
+          struct poly *count = &dds[c]->count[0];
+          max = 0;
+          for (j = 0; j <= target; j++)
+            {
+              for (k = 0; k < count->len && count->lo + k <= j; k++)
+                rest[c][j] += count->c[k] * rest[c+1][j - count->lo - k];
+              max = rest[c][j] > max ? rest[c][j] : max;
+            }
+          if (max > 0)
+            for (j = 0; j <= target; j++)
+              rest[c][j] /= max;
+        }
+      if (rest[0][target] <= 0)
+        consis = false;
+    }
+
+  if (print >= PRINT_BASIC)
+    printf ("Seed: %llu\n", (unsigned long long) rng_state);
+  if (!consis)
+    {
+      if (print >= PRINT_BASIC)
+        printf ("No solution.\n");
+    }
+  else
+    {
+      int *interior = (int *) malloc ((csp->ninterior + 1) * sizeof (int));
+      int s;
+      for (s = 0; s < samples; s++)
+        {
+          int left = target;
+          for (c = 0; c < csp->ncomps; c++)
+            {
+              // Deal this component its mines.
+              int mines = 0;
+              if (by_mines)
+                {
+                  struct poly *count = &dds[c]->count[0];
+                  double total = 0;
+                  for (k = 0; k < count->len && count->lo + k <= left; k++)
+                    total += count->c[k] * rest[c+1][left - count->lo - k];
+                  double r = rng_double () * total;
+                  for (k = 0; k < count->len - 1
+                         && count->lo + k + 1 <= left; k++)
+                    {
+                      r -= count->c[k] * rest[c+1][left - count->lo - k];
+                      if (r < 0)
+                        break;
+                    }
+                  mines = count->lo + k;
+                  left -= mines;
+                }
+              dd_sample (dds[c], csp, mines, grid);
+            }
+
+          // Pick the interior's mines: the first LEFT of a partial shuffle,
+          // or each with even odds.
+          memcpy (interior, csp->interior, csp->ninterior * sizeof (int));
+          for (i = 0; i < csp->ninterior; i++)
+            {
+              bool on;
+              if (by_mines)
+                {
+                  j = i + (int) (rng_double () * (csp->ninterior - i));
+                  int tmp = interior[i];
+                  interior[i] = interior[j];
+                  interior[j] = tmp;
+                  on = i < left;
+                }
+              else
+                on = rng_double () < 0.5;
+              struct ind ind = csp->vars[interior[i]];
+              grid[ind.row][ind.col] = on ? MINE_ON : MINE_OFF;
+            }
+
+          if (print >= PRINT_BASIC)
+            board_print (grid);
+        }
+      free (interior);
+    }
+
+  if (rest)
+    for (c = 0; c <= csp->ncomps; c++)
+      free (rest[c]);
+  free (rest);
+  for (c = 0; c < csp->ncomps; c++)
+    if (dds[c])
+      dd_free (dds[c]);
+  free (dds);
+  free (level);
+  csp_free (csp);
+}
+
+/* Count the solutions of GRID with a decision diagram over every unknown in
+   search order, as zdd_solutions () builds, by the paths from its root to
+   its terminal. Returns -1 if the diagram is too wide to build. */
+static long double dd_goal_count (int **grid)
+{
+  struct csp *csp = csp_build (grid, thr_data[0].bufs.ind, total_unknowns);
+  int n = csp->nvars;
+  int *order = (int *) malloc ((n + 1) * sizeof (int));
+  int *level = (int *) malloc ((n + 1) * sizeof (int));
+  long double count = 0;
+  int i, u;
+  for (i = 0; i < n; i++)
+    order[i] = i;
+
+  if (!csp->unsat && mine_target >= -1 && mine_target <= n)
+    {
+      struct dd *dd = dd_build (csp, order, n, level, false, mine_target);
+      if (!dd)
+        count = -1;
+      else if (dd->level_start[n] < dd->level_start[n+1])
+        {
+          // Children come after their parents, and the terminal last.
+          long double *paths = (long double *)
+            malloc (dd->nnodes * sizeof (long double));
+          paths[dd->nnodes - 1] = 1;
+          for (u = dd->nnodes - 2; u >= 0; u--)
+            paths[u] = (dd->child[u][0] < 0 ? 0 : paths[dd->child[u][0]])
+              + (dd->child[u][1] < 0 ? 0 : paths[dd->child[u][1]]);
+          count = paths[0];
+          free (paths);
+        }
+      if (dd)
+        dd_free (dd);
+    }
+
+  free (order);
+  free (level);
+  csp_free (csp);
+  return count;
+}
+
+/* Build the set of all solutions as a ZDD and write it to ZDD_FILE. A single
+   decision diagram is built over every unknown in search order, then reduced
+   bottom up: a node whose on child leads to no solution is replaced by its
+   off child, and nodes testing the same unknown with the same children are
+   merged. Its size thus follows the width of the board's constraints rather
+   than the number of solutions. */
+static void zdd_solutions (int **grid)
+{
+  struct csp *csp = csp_build (grid, thr_data[0].bufs.ind, total_unknowns);
+  int n = csp->nvars;
+  int *order = (int *) malloc ((n + 1) * sizeof (int));
+  int *level = (int *) malloc ((n + 1) * sizeof (int));
+  int i, u;
+  for (i = 0; i < n; i++)
+    order[i] = i;
+
+  struct ms_zdd zdd;
+  zdd.rows = nrows - 2;
+  zdd.cols = ncols - 2;
+  zdd.nvars = n;
+  zdd.vars = (int (*)[2]) malloc ((n + 1) * sizeof *zdd.vars);
+  for (i = 0; i < n; i++)
+    {
+      zdd.vars[i][0] = csp->vars[i].row - 1;
+      zdd.vars[i][1] = csp->vars[i].col - 1;
+    }
+  zdd.nnodes = 2;
+  zdd.root = MS_ZDD_EMPTY;
+
+  // More mines wanted than unknowns left can't be met, and with no unknowns
+  // left the diagram has no level to check it on.
+  struct dd *dd = NULL;
+  if (!csp->unsat && mine_target >= -1 && mine_target <= n)
+    {
+      dd = dd_build (csp, order, n, level, false, mine_target);
+      if (!dd)
+        {
+          fprintf (stderr, "Solution set too wide to build.\n");
+          exit (1);
+        }
+    }
+
+  if (dd && dd->level_start[n] < dd->level_start[n+1])
+    {
+      // Reduced node of each diagram node, and a table of reduced nodes by
+      // children. A level's nodes only point to lower levels, so the table
+      // is cleared between levels.
+      int *id = (int *) malloc (dd->nnodes * sizeof (int));
+      zdd.nodes = (struct ms_zdd_node *)
+        malloc ((dd->nnodes + 2) * sizeof *zdd.nodes);
+      int table_cap = 1024;
+      while (table_cap < 2 * dd->nnodes)
+        table_cap *= 2;
+      int *table = (int *) malloc (table_cap * sizeof (int));
+
+      id[dd->level_start[n]] = MS_ZDD_UNIT;
+      for (i = n - 1; i >= 0; i--)
+        {
+          int start = dd->level_start[i];
+          int end = dd->level_start[i+1];
+          int size = 1;
+          while (size < 2 * (end - start))
+            size *= 2;
+          memset (table, -1, size * sizeof (int));
+          for (u = start; u < end; u++)
+            {
+              int lo = dd->child[u][0] < 0 ? MS_ZDD_EMPTY
+                : id[dd->child[u][0]];
+              int hi = dd->child[u][1] < 0 ? MS_ZDD_EMPTY
+                : id[dd->child[u][1]];
+              if (hi == MS_ZDD_EMPTY)
+                {
+                  id[u] = lo;
+                  continue;
+                }
+
+              unsigned int h = ((unsigned int) lo * 2654435761u
+                                ^ (unsigned int) hi * 40503u) & (size - 1);
+              while (table[h] >= 0 && (zdd.nodes[table[h]].lo != lo
+                                       || zdd.nodes[table[h]].hi != hi))
+                h = (h + 1) & (size - 1);
+              if (table[h] < 0)
+                {
+                  struct ms_zdd_node *node = &zdd.nodes[zdd.nnodes];
+                  node->var = i;
+                  node->lo = lo;
+                  node->hi = hi;
+                  table[h] = zdd.nnodes++;
+                }
+              id[u] = table[h];
+            }
+        }
+      zdd.root = id[0];
+
+      free (table);
+      free (id);
+    }
+  else
+    zdd.nodes = (struct ms_zdd_node *) malloc (2 * sizeof *zdd.nodes);
+
+  if (ms_zdd_write (&zdd, zdd_file))
+    {
+      fprintf (stderr, "Could not write %s.\n", zdd_file);
+      exit (1);
+    }
+  if (print >= PRINT_BASIC)
+    {
+      printf ("Number of goal states: %.0Lf\n", ms_zdd_count (&zdd));
+      printf ("Diagram nodes: %d\n", zdd.nnodes);
+    }
+
+  if (dd)
+    dd_free (dd);
+  free (zdd.nodes);
+  free (zdd.vars);
+  free (order);
+  free (level);
+  csp_free (csp);
+}
+
+
+
+/*****************************************************************************
+ *
+ *  Window functions.
+ *
+ ****************************************************************************/
+
+/* Solve the next grid in FH in window mode, and print the results. The
+   grid is read a row at a time, and its unknowns assigned in row order,
+   keeping only the states of the boundary between the unknowns assigned
+   and the rest, as dd_build () keeps a level of its diagram: the mines
+   each numbered tile open there still needs, with the number of
+   assignments before that lead to it. Unknowns next to no numbered tile
+   only double the count. */
+static void window_solve (FILE *fh)
+{
+  struct window w;
+  char inbuf[INBUF_SIZ];
+  double start = now_ms ();
+  int i, j;
+
+  dims_read (fh);
+  if (print >= PRINT_BASIC)
+    printf ("Dimensions: %d, %d\n", nrows - 2, ncols - 2);
+  memset (&w, 0, sizeof w);
+  for (i = 0; i < WINDOW_ROWS; i++)
+    w.rows[i] = (int *) malloc (ncols * sizeof (int));
+  w.slot_of = (int *) malloc (WINDOW_ROWS * ncols * sizeof (int));
+  for (i = 0; i < WINDOW_ROWS * ncols; i++)
+    w.slot_of[i] = -1;
+  w.half = -1;
+  w.keys_cap = w.next_cap = 1;
+  w.keys = (unsigned char *) malloc (w.keys_cap);
+  w.next_keys = (unsigned char *) malloc (w.next_cap);
+  w.states_cap = 1;
+  w.hash = (uint64_t *) malloc (sizeof (uint64_t));
+  w.next_hash = (uint64_t *) malloc (sizeof (uint64_t));
+  w.count = (long double *) malloc (sizeof (long double));
+  w.next_count = (long double *) malloc (sizeof (long double));
+  w.table_cap = 16;
+  w.table = (int *) malloc (w.table_cap * sizeof (int));
+
+  // Nothing is assigned yet: one state, with an empty key.
+  w.nstates = w.most = 1;
+  w.hash[0] = 0;
+  w.count[0] = 1;
+
+  // The tiles around row I's unknowns are checked on the rows two either
+  // side of it.
+  for (i = 0; i < 3; i++)
+    window_load (&w, fh, i);
+  for (i = 1; i < nrows - 1 && w.nstates > 0; i++)
+    {
+      window_load (&w, fh, i + 2);
+      for (j = 1; j < ncols - 1 && w.nstates > 0; j++)
+        if (window_tile (&w, i, j) == UNKNOWN)
+          window_step (&w, i, j);
+        else if (!window_check (&w, i, j))
+          w.nstates = 0;
+      window_compact (&w);
+    }
+
+  // Skip the rest of a grid found inconsistent early, for the next.
+  for (i += 2; i < nrows - 1 && !w.ended; i++)
+    if (!row_read (fh, inbuf, &w.half))
+      break;
+
+  long double count = w.nstates > 0 ? w.count[0] : 0;
+  long double total = ldexpl (count, w.scale);
+  goal_states = total < INT_MAX ? (int) total : INT_MAX;
+  if (print >= PRINT_BASIC)
+    {
+      if (single || count == 0)
+        printf ("Number of goal states: %d\n", count > 0);
+      else if (isfinite (total))
+        printf ("Number of goal states: %.0Lf\n", total);
+      else
+        {
+          // Past the range of a long double.
+          long double exp10 = log10l (count) + w.scale * log10l (2);
+          long double whole = floorl (exp10);
+          printf ("Number of goal states: %.6Lfe+%.0Lf\n",
+                  powl (10, exp10 - whole), whole);
+        }
+    }
+  if (print >= PRINT_MIN)
+    {
+      printf ("Most boundary states: %d\n", w.most);
+      printf ("Elapsed time: %f ms\n", now_ms () - start);
+    }
+
+  for (i = 0; i < WINDOW_ROWS; i++)
+    free (w.rows[i]);
+  free (w.slot_of);
+  free (w.keys);
+  free (w.next_keys);
+  free (w.hash);
+  free (w.next_hash);
+  free (w.count);
+  free (w.next_count);
+  free (w.table);
+}
+
+/* Hash of the mines NEED still needed by the numbered tile at key position
+   POS. A key's hash is the sum over its positions, so that a step changing
+   a few positions changes its hash in as few terms. */
+static inline uint64_t window_mix (int pos, int need)
+{
+  uint64_t h = ((uint64_t) pos << 4 | need) * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  return h ^ h >> 29;
+}
+
+/* Tile at ROW, COL of the rows W holds. */
+static inline int window_tile (struct window *w, int row, int col)
+{
+  return w->rows[row & (WINDOW_ROWS - 1)][col];
+}
+
+/* Read row ROW of the grid in FH into W, in place of the row WINDOW_ROWS
+   before. Rows past the grid, and the border, are off. */
+static void window_load (struct window *w, FILE *fh, int row)
+{
+  char inbuf[INBUF_SIZ];
+  int *tiles = w->rows[row & (WINDOW_ROWS - 1)];
+  int j;
+  for (j = 0; j < ncols; j++)
+    {
+      tiles[j] = MINE_OFF;
+      w->slot_of[(row & (WINDOW_ROWS - 1)) * ncols + j] = -1;
+    }
+  if (row < 1 || row > nrows - 2 || w->ended)
+    return;
+  if (!row_read (fh, inbuf, &w->half))
+    {
+      w->ended = true;
+      return;
+    }
+  for (j = 0; j < ncols - 2; j++)
+    tiles[j+1] = tile_value (inbuf[j]);
+}
+
+/* Whether the tile at ROW, COL of W, if a numbered tile with no unknowns
+   around it, has as many mines around it as its number. The others are
+   checked as their unknowns are assigned. */
+static bool window_check (struct window *w, int row, int col)
+{
+  int tile_num = window_tile (w, row, col);
+  int mines = 0;
+  int i, j;
+  if (tile_num < 0 || tile_num > 8)
+    return true;
+  for (i = -1; i < 2; i++)
+    for (j = -1; j < 2; j++)
+      {
+        int t = window_tile (w, row + i, col + j);
+        if (t == UNKNOWN)
+          return true;
+        if (is_mine (t))
+          mines++;
+      }
+  return mines == tile_num;
+}
+
+/* Make the key of LEN bytes written past the next level's states of W a
+   state of it, hashed HASH, with COUNT assignments leading to it, or add
+   COUNT to the state with an equal key if there is one. */
+static void window_add (struct window *w, int len, uint64_t hash,
+                        long double count)
+{
+  unsigned char *key = w->next_keys + (size_t) w->nnext * len;
+  unsigned int mask = w->table_size - 1;
+  unsigned int h = hash & mask;
+  while (w->table[h] >= 0
+         && (w->next_hash[w->table[h]] != hash
+             || memcmp (w->next_keys + (size_t) w->table[h] * len, key,
+                        len)))
+    h = (h + 1) & mask;
+  if (w->table[h] >= 0)
+    {
+      w->next_count[w->table[h]] += count;
+      return;
+    }
+  if (w->nnext >= WINDOW_STATES)
+    {
+      fprintf (stderr, "Too many boundary states, past %d.\n",
+               WINDOW_STATES);
+      exit (1);
+    }
+  w->next_hash[w->nnext] = hash;
+  w->next_count[w->nnext] = count;
+  w->table[h] = w->nnext++;
+}
+
+/* Assign unknown ROW, COL both ways in every state of W, and keep the
+   states that every numbered tile around it still allows, merging those
+   left with equal keys. The numbered tiles it is the first unknown of, in
+   row order, open at it, and get a key position at the end; those it is
+   the last unknown of close at it, and keep theirs, at 0, until
+   window_compact (). */
+static void window_step (struct window *w, int row, int col)
+{
+  struct
+  {
+    int pos;                  // Key position, or -1 if opening.
+    int need;                 // Mines needed, if opening.
+    int rem;                  // Unknowns around it past this one.
+  } slots[8];
+  int nslots = 0;
+  int nnew = 0;
+  int i, j, k, l, s, x;
+
+  for (i = -1; i < 2; i++)
+    for (j = -1; j < 2; j++)
+      {
+        int r = row + i;
+        int c = col + j;
+        int tile_num = window_tile (w, r, c);
+        if (tile_num < 0 || tile_num > 8)
+          continue;
+        int before = 0;
+        int after = 0;
+        int mines = 0;
+        for (k = -1; k < 2; k++)
+          for (l = -1; l < 2; l++)
+            {
+              int t = window_tile (w, r + k, c + l);
+              if (is_mine (t))
+                mines++;
+              else if (t != UNKNOWN || (r + k == row && c + l == col))
+                continue;
+              else if (r + k < row || (r + k == row && c + l < col))
+                before++;
+              else
+                after++;
+            }
+        int *slot_of = &w->slot_of[(r & (WINDOW_ROWS - 1)) * ncols + c];
+        slots[nslots].rem = after;
+        if (before)
+          {
+            slots[nslots].pos = *slot_of;
+            if (!after)
+              *slot_of = -1;
+          }
+        else
+          {
+            // A tile opening and closing at once never gets a position.
+            slots[nslots].pos = -1;
+            slots[nslots].need = tile_num - mines;
+            if (after)
+              *slot_of = w->len + nnew++;
+          }
+        nslots++;
+      }
+
+  // Either state of an unknown next to no numbered tile leads to the same
+  // states.
+  if (!nslots)
+    {
+      w->scale++;
+      return;
+    }
+
+  // Make room for twice the states, with a hash table at most a quarter
+  // full.
+  int len = w->len + nnew;
+  if ((size_t) w->nstates * 2 * len > w->next_cap)
+    {
+      w->next_cap = (size_t) w->nstates * 2 * len;
+      w->next_keys = (unsigned char *) realloc (w->next_keys, w->next_cap);
+    }
+  if (w->states_cap < 2 * w->nstates)
+    {
+      w->states_cap = 2 * w->nstates;
+      w->hash = (uint64_t *)
+        realloc (w->hash, w->states_cap * sizeof (uint64_t));
+      w->next_hash = (uint64_t *)
+        realloc (w->next_hash, w->states_cap * sizeof (uint64_t));
+      w->count = (long double *)
+        realloc (w->count, w->states_cap * sizeof (long double));
+      w->next_count = (long double *)
+        realloc (w->next_count, w->states_cap * sizeof (long double));
+    }
+  w->table_size = 16;
+  while (w->table_size < 4 * w->nstates)
+    w->table_size *= 2;
+  if (w->table_size > w->table_cap)
+    {
+      w->table_cap = w->table_size;
+      w->table = (int *) realloc (w->table, w->table_cap * sizeof (int));
+    }
+  memset (w->table, -1, w->table_size * sizeof (int));
+
+  w->nnext = 0;
+  for (s = 0; s < w->nstates; s++)
+    for (x = 0; x < 2; x++)
+      {
+        unsigned char *parent = w->keys + (size_t) s * w->len;
+        unsigned char *key = w->next_keys + (size_t) w->nnext * len;
+        uint64_t hash = w->hash[s];
+        int next = w->len;
+        memcpy (key, parent, w->len);
+        for (i = 0; i < nslots; i++)
+          {
+            int pos = slots[i].pos;
+            int need = (pos >= 0 ? parent[pos] : slots[i].need) - x;
+            if (need < 0 || need > slots[i].rem)
+              break;
+            if (pos >= 0)
+              {
+                hash += window_mix (pos, need) - window_mix (pos, parent[pos]);
+                key[pos] = need;
+              }
+            else if (slots[i].rem > 0)
+              {
+                hash += window_mix (next, need);
+                key[next++] = need;
+              }
+          }
+        if (i == nslots)
+          window_add (w, len, hash, w->count[s]);
+      }
+
+  // Move on to the next level.
+  unsigned char *keys = w->keys;
+  w->keys = w->next_keys;
+  w->next_keys = keys;
+  size_t cap = w->keys_cap;
+  w->keys_cap = w->next_cap;
+  w->next_cap = cap;
+  uint64_t *hash = w->hash;
+  w->hash = w->next_hash;
+  w->next_hash = hash;
+  long double *count = w->count;
+  w->count = w->next_count;
+  w->next_count = count;
+  w->nstates = w->nnext;
+  w->len = len;
+  if (w->most < w->nstates)
+    w->most = w->nstates;
+}
+
+/* Drop the key positions of the numbered tiles closed in W, which are at 0
+   in every state, and scale the counts down if they grow large. */
+static void window_compact (struct window *w)
+{
+  int *map = (int *) malloc ((w->len + 1) * sizeof (int));
+  int len = 0;
+  int i, s;
+
+  // Keep the positions of open tiles, in order.
+  for (i = 0; i < w->len; i++)
+    map[i] = -1;
+  for (i = 0; i < WINDOW_ROWS * ncols; i++)
+    if (w->slot_of[i] >= 0)
+      map[w->slot_of[i]] = 0;
+  for (i = 0; i < w->len; i++)
+    if (!map[i])
+      map[i] = len++;
+  for (i = 0; i < WINDOW_ROWS * ncols; i++)
+    if (w->slot_of[i] >= 0)
+      w->slot_of[i] = map[w->slot_of[i]];
+
+  // Positions only move down, so keys can be rewritten in place.
+  if (len < w->len)
+    {
+      for (s = 0; s < w->nstates; s++)
+        {
+          unsigned char *from = w->keys + (size_t) s * w->len;
+          unsigned char *to = w->keys + (size_t) s * len;
+          uint64_t hash = 0;
+          for (i = 0; i < w->len; i++)
+            if (map[i] >= 0)
+              {
+                hash += window_mix (map[i], from[i]);
+                to[map[i]] = from[i];
+              }
+          w->hash[s] = hash;
+        }
+      w->len = len;
+    }
+  free (map);
+
+  // A row doubles the counts at most once for each unknown in it, so this
+  // keeps them well within the range of a long double.
+  long double most = 0;
+  for (s = 0; s < w->nstates; s++)
+    if (most < w->count[s])
+      most = w->count[s];
+  if (most > ldexpl (1, 8192))
+    {
+      for (s = 0; s < w->nstates; s++)
+        w->count[s] = ldexpl (w->count[s], -8192);
+      w->scale += 8192;
+    }
+}
+
+/*****************************************************************************
+ *
+ *  Lane functions.
+ *
+ ****************************************************************************/
+
+/* Add the grid in FH, whose dimensions were just read, to LN, as grid NUM
+   of the batch. Full lanes, or lanes of grids of other dimensions, are
+   solved first. Returns false, reading nothing, if the grid is too big for
+   lane mode. */
+static bool lanes_add (struct lanes *ln, FILE *fh, int num)
+{
+  int i;
+  if ((nrows - 2) * (ncols - 2) > LANE_TILES)
+    return false;
+  if (ln->n && (ln->n == LANES || nrows != ln->rows || ncols != ln->cols))
+    lanes_solve (ln);
+
+  if (!ln->n)
+    {
+      ln->first = num;
+      ln->rows = nrows;
+      ln->cols = ncols;
+      if (ntiles > ln->cap)
+        {
+          ln->cap = ntiles;
+          ln->tiles = (int *)
+            realloc (ln->tiles, LANES * ln->cap * sizeof (int));
+          ln->unknown = (uint64_t *)
+            realloc (ln->unknown, ln->cap * sizeof (uint64_t));
+          ln->mine = (uint64_t *)
+            realloc (ln->mine, ln->cap * sizeof (uint64_t));
+        }
+      ln->grid = (int **) realloc (ln->grid, nrows * sizeof (int *));
+      memset (ln->unknown, 0, ntiles * sizeof (uint64_t));
+      memset (ln->mine, 0, ntiles * sizeof (uint64_t));
+    }
+
+  int *tiles = ln->tiles + ln->n * ntiles;
+  for (i = 0; i < nrows; i++)
+    ln->grid[i] = tiles + i * ncols;
+  grid_read (fh, ln->grid);
+
+  uint64_t bit = 1ULL << ln->n;
+  for (i = 0; i < ntiles; i++)
+    if (tiles[i] == UNKNOWN)
+      ln->unknown[i] |= bit;
+    else if (is_mine (tiles[i]))
+      ln->mine[i] |= bit;
+  ln->goals[ln->n++] = 0;
+  return true;
+}
+
+/* Solve the grids in LN, print the results of each, as batch mode does,
+   and empty it. The grid read last, which may be of other dimensions, is
+   left as it was. */
+static void lanes_solve (struct lanes *ln)
+{
+  if (!ln->n)
+    return;
+  int rows = nrows;
+  int cols = ncols;
+  double start = now_ms ();
+  int i, j;
+
+  nrows = ln->rows;
+  ncols = ln->cols;
+  ntiles = nrows * ncols;
+  lanes_search (ln);
+
+  for (i = 0; i < ln->n && print >= PRINT_BASIC; i++)
+    {
+      printf ("Grid %d\n", ln->first + i);
+      printf ("Dimensions: %d, %d\n", nrows - 2, ncols - 2);
+      for (j = 0; j < nrows; j++)
+        ln->grid[j] = ln->tiles + i * ntiles + j * ncols;
+      board_print (ln->grid);
+      printf ("Number of goal states: %lld\n", ln->goals[i]);
+    }
+  if (print >= PRINT_MIN)
+    printf ("Grids %d to %d solved in lanes: %f ms\n", ln->first,
+            ln->first + ln->n - 1, now_ms () - start);
+
+  nrows = rows;
+  ncols = cols;
+  ntiles = nrows * ncols;
+  ln->n = 0;
+}
+
+/* Find the solutions of every grid in LN at once, or with SINGLE, one of
+   each, into its GOALS. The search assigns each tile inside the border in
+   turn, in row order, as the search of one grid assigns its unknowns, but
+   to every grid still consistent with the tiles assigned so far, a bit of
+   a mask each, its lane. A tile known in a grid only takes the state the
+   grid gives it there, and a grid drops out of the subtree as soon as a
+   numbered tile's mines go out of bounds, or the mines in all pass the
+   mine target. The mines assigned around a tile are the same in all the
+   lanes left, so the bounds are looked up, for all of them at once, in a
+   table of the lanes each count is within the bounds of, for each tile
+   and each tile around it last assigned. */
+static void lanes_search (struct lanes *ln)
+{
+  uint64_t all = ln->n == LANES ? ~0ULL : (1ULL << ln->n) - 1;
+  int npos = (nrows - 2) * (ncols - 2);
+  uint64_t *ok = (uint64_t *) malloc (ntiles * 90 * sizeof (uint64_t));
+  int *count = (int *) calloc (ntiles, sizeof (int));
+  int *pos = (int *) malloc (npos * sizeof (int));
+  uint64_t *mask = (uint64_t *) malloc ((npos + 1) * sizeof (uint64_t));
+  signed char *state = (signed char *) malloc (npos + 1);
+  int off[9];
+  int i, j, k, l, t;
+
+  for (t = 0; t < 9; t++)
+    off[t] = (t / 3 - 1) * ncols + t % 3 - 1;
+  k = 0;
+  for (i = 1; i < nrows - 1; i++)
+    for (j = 1; j < ncols - 1; j++)
+      pos[k++] = i * ncols + j;
+
+  // OK holds, for each tile Q, each T of the tiles around it, in row
+  // order, and each number S of mines among those up to T, the lanes in
+  // which Q's number less S is at least the mines known past T, and at
+  // most those plus the unknowns. Tiles not numbered allow anything. Those
+  // bounds are kept one hot, a mask of lanes for each value: HI[V + 1] for
+  // V, or HI[0] for below 0, and LO[V] for V, or LO[0] for 0 or below.
+  for (i = 0; i < ntiles * 90; i++)
+    ok[i] = ~0ULL;
+  for (k = 0; k < npos; k++)
     {
-      while (i < total_unknowns)
+      int q = pos[k];
+      uint64_t hi[10], lo[9];
+      uint64_t numbered = 0;
+      int s, v;
+      memset (hi, 0, sizeof hi);
+      memset (lo, 0, sizeof lo);
+      for (l = 0; l < ln->n; l++)
         {
-          int src = mine_src (grid[ind[i].row][ind[i].col]);
-          if (src >= init)
+          v = ln->tiles[l * ntiles + q];
+          if (0 <= v && v <= 8)
             {
-              grid[ind[i].row][ind[i].col] = UNKNOWN;
+              hi[v+1] |= 1ULL << l;
+              lo[v] |= 1ULL << l;
+              numbered |= 1ULL << l;
             }
-          i++;
         }
-    }
-}
+      if (!numbered)
+        continue;
 
-/* When an unknown is forced on/off, use this function to set the value.
-   Later, we can determine which unknown forced this unknown to turn on/off. */
-static inline int force_on (int unknown_num)
-{
-  return unknown_num + MINE_ON + 1;
-}
-static inline int force_off (int unknown_num)
-{
-  return -force_on (unknown_num);
-}
+      for (t = 8; t >= 0; t--)
+        {
+          uint64_t *row = &ok[(q * 9 + t) * 10];
+          uint64_t at_least[10];
+          uint64_t at_most = 0;
+          at_least[9] = 0;
+          for (s = 8; s >= 0; s--)
+            at_least[s] = at_least[s+1] | hi[s+1];
+          for (s = 0; s <= t + 1; s++)
+            {
+              if (s < 9)
+                at_most |= lo[s];
+              row[s] = ~numbered | (at_least[s] & at_most);
+            }
 
-/* Check if a mapped tile value denotes if the mine is on. False is returned
-   otherwise. This function is not meant to be used when the tile being checked
-   is not a mine. */
-static inline bool is_mine (int tile_val)
-{
-  return (tile_val >= MINE_ON);
-}
+          // Move the bounds down in the lanes the tile at T is a mine, or
+          // for LO, unknown in.
+          uint64_t mine = ln->mine[q + off[t]];
+          uint64_t down = mine | ln->unknown[q + off[t]];
+          hi[0] |= hi[1] & mine;
+          for (v = 1; v < 9; v++)
+            hi[v] = (hi[v] & ~mine) | (hi[v+1] & mine);
+          hi[9] &= ~mine;
+          lo[0] |= lo[1] & down;
+          for (v = 1; v < 8; v++)
+            lo[v] = (lo[v] & ~down) | (lo[v+1] & down);
+          lo[8] &= ~down;
+        }
+    }
 
-/* Returns the index of the unknown tile that forced this mine to be on or
-   off. -1 is returned if TILE_VAL denotes an unknown or a number, or if this
-   mine was forced to be on/off from the start. */
-static inline int mine_src (int tile_val)
-{
-  int n = abs (tile_val);
-  if (n <= MINE_ON)
-    return -1;
-  else
-    return (n - MINE_ON - 1);
-}
+  uint64_t done = 0;
+  int mines = 0;
+  k = 0;
+  mask[0] = all;
+  state[0] = -1;
+  while (k >= 0)
+    {
+      if (k == npos)
+        {
+          uint64_t m = mask[k];
+          if (mine_target >= 0 && mines != mine_target)
+            m = 0;
+          if (single)
+            done |= m;
+          for (; m; m &= m - 1)
+            ln->goals[__builtin_ctzll (m)]++;
+          if (single && done == all)
+            break;
+          k--;
+          continue;
+        }
+
+      // Take back the mine tried last here, then try the next state.
+      int p = pos[k];
+      if (state[k] == 1)
+        {
+          mines--;
+          for (t = 0; t < 9; t++)
+            count[p + off[t]]--;
+        }
+      if (++state[k] > 1)
+        {
+          k--;
+          continue;
+        }
+      uint64_t m = mask[k] & ~done;
+      if (state[k])
+        {
+          m &= ln->unknown[p] | ln->mine[p];
+          mines++;
+          for (t = 0; t < 9; t++)
+            count[p + off[t]]++;
+          if (mine_target >= 0 && mines > mine_target)
+            m = 0;
+        }
+      else
+        m &= ~ln->mine[p];
 
+      // P is tile 8 - T around the tile at offset T from it.
+      for (t = 0; t < 9 && m; t++)
+        {
+          int q = p + off[t];
+          m &= ok[(q * 9 + 8 - t) * 10 + count[q]];
+        }
+      if (m)
+        {
+          mask[++k] = m;
+          state[k] = -1;
+        }
+    }
 
+  free (ok);
+  free (count);
+  free (pos);
+  free (mask);
+  free (state);
+}
 
 /*****************************************************************************
  *
@@ -1042,6 +6774,36 @@ static void thread_alloc ()
   pthread_mutex_init (thr_lock, NULL);
   pthread_cond_init (thr_cond, NULL);
   thr_data = (struct search *) malloc (avail_threads * sizeof *thr_data);
+
+  // Statistics are aligned to cache lines, which malloc () doesn't promise.
+  if (posix_memalign ((void **) &thr_stats, CACHE_LINE,
+                      avail_threads * sizeof *thr_stats))
+    {
+      fprintf (stderr, "Out of memory.\n");
+      exit (1);
+    }
+  memset (thr_stats, 0, avail_threads * sizeof *thr_stats);
+  int i;
+  double now = now_ms ();
+  for (i = 0; i < avail_threads; i++)
+    thr_stats[i].idle_since = now;
+
+#ifdef MS_TRACE
+  if (posix_memalign ((void **) &thr_trace, CACHE_LINE,
+                      avail_threads * sizeof *thr_trace))
+    {
+      fprintf (stderr, "Out of memory.\n");
+      exit (1);
+    }
+  for (i = 0; i < avail_threads; i++)
+    {
+      thr_trace[i].head = 0;
+      thr_trace[i].recs = (struct trace_rec *)
+        malloc (TRACE_RING * sizeof (struct trace_rec));
+    }
+  trace_ms0 = now_ms ();
+  trace_tsc0 = trace_tsc ();
+#endif
 }
 
 /* Call after input file is read, and thus board dimensions are known. We can
@@ -1054,12 +6816,14 @@ static void thread_struct_alloc ()
   for (i = 0; i < max_threads; i++)
     {
       thr_data[i].avail = true;
+      thr_data[i].running = false;
 
-      // Allocate memory for buffers.
+      // Allocate memory for buffers. The search order of the unknowns is
+      // the same for every thread.
       thr_data[i].bufs.buf = (int *) malloc (ntiles * sizeof (int));
       thr_data[i].bufs.grid = (int **) malloc (nrows * sizeof (int *));
-      thr_data[i].bufs.ind =
-        (struct ind *) malloc ((ntiles + 1) * sizeof (struct ind));
+      thr_data[i].bufs.ind = i ? thr_data[0].bufs.ind
+        : (struct ind *) malloc ((ntiles + 1) * sizeof (struct ind));
 
       // GRID is a 2D array of [row][col] ordering, so GRID is an array of pointers
       // to the start of each row.
@@ -1088,29 +6852,172 @@ static int thread_find ()
   exit (1);
 }
 
-/* At the end of the program, free thread memory. */
+/* Free thread memory, once the grid is done with. */
 static void thread_free ()
 {
-  pthread_mutex_destroy (thr_lock, NULL);
-  pthread_cond_destroy (thr_cond, NULL);
+  pthread_mutex_destroy (thr_lock);
+  pthread_cond_destroy (thr_cond);
   int i;
   for (i = 0; i < max_threads; i++)
     {
       free (thr_data[i].bufs.buf);
       free (thr_data[i].bufs.grid);
-      free (thr_data[i].bufs.ind);
     }
+  free (thr_data[0].bufs.ind);
   free (thr_data);
+  free (thr_stats);
+  free (thr_lock);
+  free (thr_cond);
+#ifdef MS_TRACE
+  for (i = 0; i < max_threads; i++)
+    free (thr_trace[i].recs);
+  free (thr_trace);
+#endif
+}
+
+/* Print one thread's statistics, or the total, as a JSON object. */
+static void stats_json (struct stats *st)
+{
+  int i;
+  printf ("{\"nodes\": %lld, \"consistency_failures\": %lld, "
+          "\"forced\": %lld, \"backtracks\": %lld, \"max_depth\": %d, "
+          "\"splits\": %lld, \"steals\": %lld, \"declined\": %lld, "
+          "\"split_ms\": %.3f, \"split_estimate_error\": %.3f, "
+          "\"idle_ms\": %.3f, \"explored\": %.6f, \"depth_histogram\": [",
+          st->nodes, st->consis_fails, st->forced, st->backtracks,
+          st->max_depth, st->splits, st->steals, st->declined, st->split_ms,
+          st->steals ? st->split_err / st->steals : 0, st->idle_ms,
+          st->explored);
+  for (i = 0; i < STATS_BUCKETS; i++)
+    printf ("%s%lld", i ? ", " : "", st->depth[i]);
+  printf ("], \"split_size_histogram\": [");
+  for (i = 0; i < STATS_BUCKETS; i++)
+    printf ("%s%lld", i ? ", " : "", st->split_size[i]);
+  printf ("]}");
+}
+
+/* Merge the statistics of every thread and print them as JSON, along with
+   the times PRE, SEARCH and TOTAL, in ms. Threads are counted as idle up to
+   now if their slot is free. A single solution search stops waiting as soon
+   as a thread finds one, so the other threads may still be counting. */
+static void stats_print (double pre, double search, double total)
+{
+  struct stats sum;
+  double now = now_ms ();
+  int i, j;
+
+  memset (&sum, 0, sizeof sum);
+  LOCK;
+  for (i = 0; i < max_threads; i++)
+    {
+      struct stats *st = &thr_stats[i];
+      if (thr_data[i].avail)
+        {
+          st->idle_ms += now - st->idle_since;
+          st->idle_since = now;
+        }
+      sum.nodes += st->nodes;
+      sum.consis_fails += st->consis_fails;
+      sum.forced += st->forced;
+      sum.backtracks += st->backtracks;
+      sum.max_depth = st->max_depth > sum.max_depth
+        ? st->max_depth : sum.max_depth;
+      sum.splits += st->splits;
+      sum.steals += st->steals;
+      sum.declined += st->declined;
+      sum.split_ms += st->split_ms;
+      sum.split_err += st->split_err;
+      sum.idle_ms += st->idle_ms;
+      sum.explored += st->explored;
+      for (j = 0; j < STATS_BUCKETS; j++)
+        {
+          sum.depth[j] += st->depth[j];
+          sum.split_size[j] += st->split_size[j];
+        }
+    }
+  UNLOCK;
+
+  printf ("{\n  \"unknowns\": %d,\n  \"goal_states\": %d,\n"
+          "  \"complete\": %s,\n  \"threads\": %d,\n", total_unknowns,
+          goal_states, atomic_load (&budget_out) ? "false" : "true",
+          max_threads);
+  printf ("  \"time_ms\": {\"preprocess\": %.3f, \"search\": %.3f, "
+          "\"total\": %.3f},\n", pre, search, total);
+  printf ("  \"depth_bucket_width\": %.3f,\n",
+          (double) total_unknowns / STATS_BUCKETS);
+  printf ("  \"total\": ");
+  stats_json (&sum);
+  printf (",\n  \"per_thread\": [\n");
+  for (i = 0; i < max_threads; i++)
+    {
+      printf ("    ");
+      stats_json (&thr_stats[i]);
+      printf ("%s\n", i < max_threads - 1 ? "," : "");
+    }
+  printf ("  ]\n}\n");
+}
+
+#ifdef MS_TRACE
+/* Time stamp counter, or a clock in ns where there is none. */
+static inline uint64_t trace_tsc ()
+{
+#if defined (__x86_64__) || defined (__i386__)
+  return __rdtsc ();
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
 }
 
-/* Copy thread ORIG's data to thread CPY's thread data structure. */
-static void thread_copy (int cpy, int orig)
+/* Append a record to this thread's trace ring. */
+static inline void trace (int type, int depth, int val, int arg)
 {
-  memcpy (thr_data[cpy].bufs.buf, thr_data[orig].bufs.buf,
-          ntiles * sizeof (int));
-  memcpy (thr_data[cpy].bufs.ind, thr_data[orig].bufs.ind,
-          (total_unknowns + 1) * sizeof (struct ind));
+  struct trace_ring *ring = &thr_trace[thread_num];
+  struct trace_rec *rec = &ring->recs[ring->head++ & (TRACE_RING - 1)];
+  rec->tsc = trace_tsc ();
+  rec->depth = depth;
+  rec->type = type;
+  rec->val = val;
+  rec->arg = arg > 0xffff ? 0xffff : arg;
+}
+
+/* Write the trace rings to TRACE_FILE: the magic "MSTRACE1", the number of
+   threads as a uint32_t and 4 bytes of padding, time stamp ticks per ms as a
+   double, then for each thread the number of records as a uint64_t and the
+   records, oldest first. trace2chrome.pl reads it. */
+static void trace_write ()
+{
+  FILE *fh = fopen (TRACE_FILE, "wb");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", TRACE_FILE);
+      return;
+    }
+
+  uint32_t head[2] = {max_threads, 0};
+  double ms = now_ms ();
+  double ticks = 1e6;
+  if (ms > trace_ms0)
+    ticks = (trace_tsc () - trace_tsc0) / (ms - trace_ms0);
+  fwrite ("MSTRACE1", 1, 8, fh);
+  fwrite (head, sizeof (uint32_t), 2, fh);
+  fwrite (&ticks, sizeof (double), 1, fh);
+
+  int i;
+  for (i = 0; i < max_threads; i++)
+    {
+      struct trace_ring *ring = &thr_trace[i];
+      uint64_t n = ring->head < TRACE_RING ? ring->head : TRACE_RING;
+      uint64_t first = (ring->head - n) & (TRACE_RING - 1);
+      uint64_t wrap = TRACE_RING - first < n ? TRACE_RING - first : n;
+      fwrite (&n, sizeof (uint64_t), 1, fh);
+      fwrite (ring->recs + first, sizeof (struct trace_rec), wrap, fh);
+      fwrite (ring->recs, sizeof (struct trace_rec), n - wrap, fh);
+    }
+  fclose (fh);
 }
+#endif
 
 
 /*****************************************************************************
@@ -1157,6 +7064,79 @@ static void diag_print (struct ind *ind, int **grid)
     }
 }
 
+/* Current time, in ms. */
+static double now_ms ()
+{
+  struct timeval now;
+  gettimeofday (&now, NULL);
+  return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+}
+
+#ifdef main
+/* Deal a random ROWS x COLS board with MINES mines, number its other tiles,
+   and turn BLANKS of its tiles to unknowns, as ms_gen.pl does. Returns the
+   board in the input format. Only ms_gen and ms_bench, which include this
+   file with main () renamed, deal boards. */
+static char * grid_random (int rows, int cols, int mines, int blanks)
+{
+  int ntiles = rows * cols;
+  int *tiles = (int *) malloc ((ntiles + 1) * sizeof (int));
+  char *grid = (char *) malloc (ntiles + 1);
+  int i, j, k, l;
+
+  for (i = 0; i < ntiles; i++)
+    tiles[i] = i;
+  for (i = ntiles - 1; i > 0; i--)
+    {
+      j = (int) (rng_double () * (i + 1));
+      int tmp = tiles[i];
+      tiles[i] = tiles[j];
+      tiles[j] = tmp;
+    }
+  memset (grid, 0, ntiles);
+  for (i = 0; i < mines; i++)
+    grid[tiles[i]] = MINE_ON_CHAR;
+  for (i = 0; i < rows; i++)
+    for (j = 0; j < cols; j++)
+      {
+        if (grid[i * cols + j] == MINE_ON_CHAR)
+          continue;
+        int count = 0;
+        for (k = i - 1; k <= i + 1; k++)
+          for (l = j - 1; l <= j + 1; l++)
+            if (k >= 0 && k < rows && l >= 0 && l < cols
+                && grid[k * cols + l] == MINE_ON_CHAR)
+              count++;
+        grid[i * cols + j] = TILE_UNMAP(count);
+      }
+
+  // Blank out tiles from a fresh shuffle.
+  for (i = ntiles - 1; i > 0; i--)
+    {
+      j = (int) (rng_double () * (i + 1));
+      int tmp = tiles[i];
+      tiles[i] = tiles[j];
+      tiles[j] = tmp;
+    }
+  for (i = 0; i < blanks; i++)
+    grid[tiles[i]] = UNKNOWN_CHAR;
+
+  char *text = (char *) malloc (ntiles + rows + 32);
+  char *p = text + sprintf (text, "%d x %d\n", rows, cols);
+  for (i = 0; i < rows; i++)
+    {
+      memcpy (p, grid + i * cols, cols);
+      p += cols;
+      *p++ = '\n';
+    }
+  *p = '\0';
+
+  free (tiles);
+  free (grid);
+  return text;
+}
+#endif
+
 /* Print the game board. */
 static void board_print (int **grid)
 {
@@ -1187,26 +7167,153 @@ static void board_print (int **grid)
 */
 static void parse_input (char *file)
 {
-  char inbuf[INBUF_SIZ];
   FILE *fh = fopen (file, "r");
+  if (!fh)
+    {
+      fprintf (stderr, "Could not open %s.\n", file);
+      exit (1);
+    }
+  parse_stream (fh);
+  fclose (fh);
+}
+
+/* Solve every grid in FILE, or standard input if there is no FILE or it is
+   -, one after another. Each gets thread structures of its own, and the
+   same mine target. */
+static void batch_solve (char *file)
+{
+  FILE *fh = input_open (file);
+  struct lanes ln;
+  int target = mine_target;
+  int n = 0;
+  memset (&ln, 0, sizeof ln);
+  while (input_next (fh))
+    {
+      // Small grids wait in lanes, for more of the same dimensions.
+      n++;
+      mine_target = target;
+      if (lanes)
+        {
+          dims_read (fh);
+          if (lanes_add (&ln, fh, n))
+            continue;
+          lanes_solve (&ln);
+        }
+
+      avail_threads = max_threads;
+      goal_states = 0;
+      if (print >= PRINT_BASIC)
+        printf ("Grid %d\n", n);
+      if (window)
+        {
+          window_solve (fh);
+          continue;
+        }
+
+      thread_alloc ();
+      if (lanes)
+        grid_parse (fh);
+      else
+        parse_stream (fh);
+      solve_grid ();
+      thread_free ();
+    }
+
+  if (lanes)
+    {
+      lanes_solve (&ln);
+      free (ln.tiles);
+      free (ln.grid);
+      free (ln.unknown);
+      free (ln.mine);
+    }
+  if (fh != stdin)
+    fclose (fh);
+}
+
+/* Open FILE, or standard input if there is no FILE or it is -. */
+static FILE * input_open (char *file)
+{
+  FILE *fh = stdin;
+  if (file && strcmp (file, "-"))
+    {
+      fh = fopen (file, "r");
+      if (!fh)
+        {
+          fprintf (stderr, "Could not open %s.\n", file);
+          exit (1);
+        }
+    }
+  return fh;
+}
+
+/* Skip the blank lines before the next grid in FH, and take note if it
+   starts a binary grid stream. Returns false at the end of FH. */
+static bool input_next (FILE *fh)
+{
+  int c = getc (fh);
+  if (!binary_input)
+    {
+      while (c != EOF && isspace (c))
+        c = getc (fh);
+      if (c == GRIDS_MAGIC[0])
+        {
+          char magic[sizeof GRIDS_MAGIC];
+          size_t len = sizeof GRIDS_MAGIC - 1;
+          magic[0] = c;
+          if (fread (magic + 1, 1, len - 1, fh) != len - 1
+              || memcmp (magic, GRIDS_MAGIC, len))
+            {
+              fprintf (stderr, "Invalid grid stream.\n");
+              exit (1);
+            }
+          binary_input = true;
+          c = getc (fh);
+        }
+    }
+  if (c == EOF)
+    return false;
+  ungetc (c, fh);
+  return true;
+}
 
-  // Get the dimensions.
-  fgets (inbuf, INBUF_SIZ, fh);
-  if (sscanf (inbuf, "%d%*[x ]%d", &nrows, &ncols) != 2)
+/* Read the dimensions of the next grid in FH into NROWS and NCOLS, each
+   with a border tile either side, and NTILES. */
+static void dims_read (FILE *fh)
+{
+  char inbuf[INBUF_SIZ];
+  if (!input_next (fh))
     {
-      fprintf (stderr, "Invalid dimensions format. ");
-      fprintf (stderr, "Please use \"W x H\" format\n");
+      fprintf (stderr, "No grid in input.\n");
       exit (1);
     }
+  if (binary_input)
+    {
+      int dims[2];
+      if (fread (dims, sizeof (int), 2, fh) != 2)
+        {
+          fprintf (stderr, "Error reading file.\n");
+          exit (1);
+        }
+      nrows = dims[0];
+      ncols = dims[1];
+    }
+  else
+    {
+      fgets (inbuf, INBUF_SIZ, fh);
+      if (sscanf (inbuf, "%d%*[x ]%d", &nrows, &ncols) != 2)
+        {
+          fprintf (stderr, "Invalid dimensions format. ");
+          fprintf (stderr, "Please use \"W x H\" format\n");
+          exit (1);
+        }
+    }
   if (ncols >= INBUF_SIZ-1)
     {
       fprintf (stderr, "NCOLS too big for input buffer.\n");
       exit (1);
     }
-  if (print >= PRINT_BASIC)
-    printf ("Dimensions: %d, %d\n", nrows, ncols);
 
-  // Add buffer to dimensions.
   nrows += 2;
   ncols += 2;
   ntiles = nrows * ncols;
@@ -1215,6 +7322,86 @@ static void parse_input (char *file)
       fprintf (stderr, "Invalid dimensions.\n");
       exit (1);
     }
+}
+
+/* Read the next row of the grid in FH into INBUF, as characters, or unpack
+   it to them from a binary grid stream. Rows there may share a byte; HALF
+   holds the 4 bits of the last byte read not yet used, or -1, and should
+   start at -1 for each grid. Returns false if the text ends first. */
+static bool row_read (FILE *fh, char *inbuf, int *half)
+{
+  int j;
+  if (!binary_input)
+    {
+      fgets (inbuf, INBUF_SIZ, fh);
+      if (feof (fh))
+        return false;
+      if (ferror (fh))
+        {
+          fprintf (stderr, "Error reading file.\n");
+          exit (1);
+        }
+      return true;
+    }
+
+  for (j = 0; j < ncols - 2; j++)
+    {
+      int code = *half;
+      *half = -1;
+      if (code < 0)
+        {
+          int byte = getc (fh);
+          if (byte == EOF)
+            {
+              fprintf (stderr, "Error reading file.\n");
+              exit (1);
+            }
+          code = byte & 15;
+          *half = byte >> 4;
+        }
+      if (code >= (int) sizeof GRIDS_TILES - 1)
+        {
+          fprintf (stderr, "Invalid tile in grid stream.\n");
+          exit (1);
+        }
+      inbuf[j] = GRIDS_TILES[code];
+    }
+  return true;
+}
+
+/* Tile value of input character C. */
+static inline int tile_value (char c)
+{
+  switch (c)
+    {
+    case UNKNOWN_CHAR:
+      return UNKNOWN;
+    case MINE_ON_CHAR:
+      return force_on (-1);
+    case MINE_OFF_CHAR:
+      return force_off (-1);
+    default:
+      return TILE_MAP (c);
+    }
+}
+
+/* Parse the tile layout of the next grid in FH. In a binary grid stream,
+   which starts with GRIDS_MAGIC, each grid is its number of rows and columns
+   (ints), then its tiles row by row, two to a byte, low 4 bits first. Each
+   4 bits are an index into GRIDS_TILES. */
+static void parse_stream (FILE *fh)
+{
+  // Get the dimensions, and add buffer to them.
+  dims_read (fh);
+  grid_parse (fh);
+}
+
+/* Parse the tiles of the grid in FH whose dimensions were just read into
+   thread 0's buffers. */
+static void grid_parse (FILE *fh)
+{
+  if (print >= PRINT_BASIC)
+    printf ("Dimensions: %d, %d\n", nrows - 2, ncols - 2);
 
   // Now that the dimensions are known, we can finish allocating
   // buffers for each thread structure.
@@ -1224,43 +7411,28 @@ static void parse_input (char *file)
   thr_data[0].avail = false;
   avail_threads--;
 
+  int **grid = thr_data[0].bufs.grid;
+  grid_read (fh, grid);
+  if (print >= PRINT_BASIC)
+    board_print (grid);
+}
+
+/* Read the tiles of the grid in FH whose dimensions were just read into
+   GRID, with the border off. */
+static void grid_read (FILE *fh, int **grid)
+{
+  char inbuf[INBUF_SIZ];
+
   // Fill in original grid.
   int i, j;
-  int **grid = thr_data[0].bufs.grid;
+  int half = -1;
   for (i = 1; i < nrows - 1; i++)
     {
-      // Read in a row as CHAR.
-      fgets (inbuf, INBUF_SIZ, fh);
-      if (feof (fh))
+      // Read in a row as CHAR, and copy it to the grid mapped to INT.
+      if (!row_read (fh, inbuf, &half))
         break;
-      if (ferror (fh))
-        {
-          fprintf (stderr, "Error reading file.\n");
-          exit (1);
-        }
-
-      // Copy to grid mapped to INT.
       for (j = 0; j < ncols-2; j++)
-        {
-          int grid_val;
-          switch (inbuf[j])
-            {
-            case UNKNOWN_CHAR:
-              grid_val = UNKNOWN;
-              break;
-            case MINE_ON_CHAR:
-              grid_val = force_on (-1);
-              break;
-            case MINE_OFF_CHAR:
-              grid_val = force_off (-1);
-              break;
-            default:
-              grid_val = TILE_MAP(inbuf[j]);
-              break;
-            }
-
-          grid[i][j+1] = grid_val;
-        }
+        grid[i][j+1] = tile_value (inbuf[j]);
     }
 
   // Set outside boundary to off. For efficiency, loops are not combined.
@@ -1273,12 +7445,9 @@ static void parse_input (char *file)
       grid[i][0] = MINE_OFF;
       grid[i][ncols-1] = MINE_OFF;
     }
-
-  if (print >= PRINT_BASIC)
-    board_print (grid);
 }
 
-/* Print help message. */
+/* Print help message, and exit. */
 static void help ()
 {
   printf ("\
@@ -1287,19 +7456,153 @@ Usage:\n\
   ms_solve [OPTION]... [FILE]\n\n\
 Options:\n\
   -a                Find all solutions.\n\
+  -b                Batch mode. Solve every grid in FILE, or standard input\n\
+                    if there is no FILE or it is -, one after another.\n\
+                    Grids are in the input format, separated by blank\n\
+                    lines, or a binary grid stream as ms_gen -B writes.\n\
+  -e PROBES         Estimate the size of the search tree and the time to\n\
+                    search it with PROBES random probes down it, and print\n\
+                    the estimate before searching. With -a, when only the\n\
+                    number of solutions is printed, a big enough tree is\n\
+                    counted with a decision diagram instead of searched;\n\
+                    that is estimated with 32 probes even without -e.\n\
+                    Probes rarely get deep into trees whose dead ends show\n\
+                    late, so those are underestimated.\n\
   -f                During search, whenever possible, force the state of an\n\
                     unknown to be on or off. This effectively reduces the\n\
                     depth of the search.\n\
   -h                Print this help message.\n\
+  -i                Interactive mode. Print the probabilities as -P does,\n\
+                    then read moves from standard input, one per line as\n\
+                    ROW COL TILE, and print them again after each. ROW and\n\
+                    COL count from 0, and TILE is a number, * or -. Only\n\
+                    the parts of the board a move changes are solved again.\n\
+  -k SAMPLES        Instead of searching for solutions, print SAMPLES\n\
+                    solutions drawn uniformly at random.\n\
   -m MINE_TARGET    Set a target number of mines.\n\
+  -N NODES          Stop the search after about NODES assignments, counted\n\
+                    every 1024 a thread. Report whether a solution was\n\
+                    found, the share of the search tree explored, and the\n\
+                    unknowns forced by the numbers around them. The goal\n\
+                    states found are then a lower bound, and the exit\n\
+                    status is 2.\n\
+  -o FILE           With -P, write the probabilities to FILE as the number of\n\
+                    rows and columns (ints), then a double per tile.\n\
   -p PRINT          Print solutions.\n\
                       0    Print nothing.\n\
                       1    Print time elapsed.\n\
                       2    Print basic information.\n\
                       3    Print found solutions.\n\
-  -r                Pre-resolve unknowns.\n\
+  -P                Instead of searching for solutions, find the probability\n\
+                    of each unknown being a mine, counting every solution\n\
+                    (with MINE_TARGET mines, if set) as equally likely.\n\
+  -q                Instead of searching for solutions, find which unknowns\n\
+                    are mines (*) or clear (-) in every solution. Unknowns\n\
+                    that can be either are left as ?.\n\
+  -r                Pre-resolve unknowns, until nothing more resolves.\n\
+  -R SEED           Seed for -e, -k and --shuffle.\n\
   -s                Sort unknowns before searching. Unknowns are sorted in\n\
                     increasing order by the number of surrounding numbered\n\
                     tiles they have.\n\
-  -t THREADS        Number of threads to use.\n\n");
+  -S                Print search statistics as JSON at the end: assignments\n\
+                    tried, consistency failures, unknowns forced, backtracks,\n\
+                    depths reached, thread splits, their cost and the\n\
+                    subtrees kept as too small, and idle time, in total\n\
+                    and for each thread.\n\
+  -t THREADS        Number of threads to use. Large grids are also\n\
+                    preprocessed on them.\n\
+  -T MS             As -N, but stop the search after about MS ms, counting\n\
+                    from the start of preprocessing.\n\
+  -v SECONDS        Print progress to standard error every SECONDS while\n\
+                    searching: the share of the search tree explored, nodes\n\
+                    tried and their rate, solutions found, and the time\n\
+                    left at that rate.\n\
+  -Z FILE           Instead of searching for solutions one by one, build the\n\
+                    set of all solutions as a zero-suppressed decision\n\
+                    diagram over the unknowns in search order, and write it\n\
+                    to FILE. See ms_zdd.h for reading it back.\n\
+  --auto            In place of -r, -s and -f, pick them for each grid from\n\
+                    quick measures of it: its unknowns, the numbered tiles\n\
+                    around them, and the size of its search tree estimated\n\
+                    with 8 probes. Also pick whether to use the threads\n\
+                    given or one, and with -a, when only the number of\n\
+                    solutions is printed, whether to count with a decision\n\
+                    diagram. Print the measures and what was picked.\n\
+  --checkpoint FILE Every minute of search, and when it ends or a budget\n\
+                    stops it, write the subtrees left to search and the\n\
+                    goal states found so far to FILE, for --resume.\n\
+  --checkpoint-every SECONDS\n\
+                    Write checkpoints every SECONDS instead.\n\
+  --cube PREFIX     Instead of searching, split the search tree into work\n\
+                    units, and write them to PREFIX.1, PREFIX.2 and on. Each\n\
+                    holds the grid, the options and a subtree to search,\n\
+                    for --unit. What splitting found is written to\n\
+                    PREFIX.0, with every unit left to search, for --merge.\n\
+                    With --resume or --unit, split the subtrees the\n\
+                    checkpoint left instead.\n\
+  --cube-depth LEVELS\n\
+                    Split LEVELS unknowns deep that the search tries both\n\
+                    states of. Default 10.\n\
+  --cube-nodes NODES\n\
+                    Split instead until the search tree of each unit is\n\
+                    estimated, as -e does, at most NODES nodes.\n\
+  --eliminate       Before searching, and after -r, fix the unknowns that\n\
+                    the numbered tiles leave one state by reducing them to\n\
+                    linear equations, and those by Gaussian elimination.\n\
+                    Combining equations pins unknowns that no numbered\n\
+                    tile does alone, as in a 1-2-1 along an edge. With -m,\n\
+                    the mine count is one more equation. Systems of more\n\
+                    than 256 unknowns are eliminated a component at a\n\
+                    time, and components that big not at all.\n\
+  --lanes           With -b, solve grids of up to 1024 tiles together, 64\n\
+                    at a time, as long as they have the same dimensions,\n\
+                    each in a bit of a word. A single search assigns the\n\
+                    tiles of all of them in turn, following each grid as\n\
+                    long as it is consistent, so that a node costs about\n\
+                    as much for 64 grids as for one. Tiny grids, whose\n\
+                    search takes less than setting up for it, solve many\n\
+                    times faster. -r, -s, -f, -t and --eliminate don't\n\
+                    apply.\n\
+  --merge           Merge the results of work units, the checkpoints given\n\
+                    as files, written by --unit with --checkpoint, and\n\
+                    PREFIX.0 of --cube. Print the goal states found in all,\n\
+                    the share of the search tree explored, and the subtrees\n\
+                    left to search, among them those of units missing.\n\
+                    With --checkpoint, also write them to FILE, for --unit.\n\
+                    Results that overlap are an error. The exit status is 2\n\
+                    if the search is not done.\n\
+  --portfolio N     Race N configurations of -r, -s, -f and --shuffle, from\n\
+                    1 to 8, in place of those given, each in a process of\n\
+                    its own with an equal share of the threads. Print the\n\
+                    output of the first to answer, and which it was, and\n\
+                    stop the others. One stopped by -N or -T has not\n\
+                    answered.\n\
+  --resume FILE     Resume the search from the checkpoint in FILE, written\n\
+                    for the same grid and options, on any number of\n\
+                    threads.\n\
+  --shuffle         With -s, order the unknowns with as many numbered tiles\n\
+                    around at random, seeded by -R.\n\
+  --split-nodes NODES\n\
+                    Hand a subtree to an idle thread only if it is estimated\n\
+                    at NODES nodes or more, fewer in proportion with more\n\
+                    threads idle. The estimate is a random probe down the\n\
+                    subtree, as -e makes. With -S, the nodes each thread\n\
+                    searched of the subtrees it took on are printed, and\n\
+                    how far off their estimates were. Default 256.\n\
+  --unit FILE       Solve the work unit in FILE, with the grid and options\n\
+                    it holds. It is resumed as a checkpoint would be, so\n\
+                    with --checkpoint, its result is written for --merge.\n\
+                    Checkpoints are work units too.\n\
+  --window          Solve the grid a few rows at a time, as it is read from\n\
+                    FILE, or standard input if there is no FILE or it is\n\
+                    -, for grids too big to hold, or with more than a\n\
+                    million unknowns. Only the feasible assignments of the\n\
+                    unknowns along the boundary between the rows done and\n\
+                    the rest are kept, with how many ways each is reached,\n\
+                    so that memory grows with the width of the grid, not\n\
+                    its height; with -a, the number of solutions is\n\
+                    printed. Solutions are not printed, there is no mine\n\
+                    target, and one thread is used. Stops if more than\n\
+                    1048576 boundary states are found.\n\n");
+  exit (0);
 }
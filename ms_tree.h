@@ -0,0 +1,332 @@
+/* Minesweeper search variants.
+   Included by ms_solve.c once for each combination of the options the
+   search checks on every node, with TREE_VARIANT set to its number. Its
+   bits select the variant:
+     1             Stop at the first solution, else count them all (-a).
+     2             A mine target is set (-m).
+     4             Force unknowns during the search (-f).
+     8             Print boards found, or diagnostics (-d, -p).
+   Each inclusion defines solve_tree_N () and its helpers, named with the
+   suffix _N, in which the options are constants, so that a variant holds
+   no checks of the options it was not built for. Its helpers are inlined
+   into it even when not optimizing, as the Makefile builds. They are
+   otherwise as resolve_tile (), consistency_check () and goal_claim ().
+*/
+
+#ifndef TREE_NAME
+#define TREE_PASTE(name, n) name##_##n
+#define TREE_EXPAND(name, n) TREE_PASTE (name, n)
+#define TREE_NAME(name) TREE_EXPAND (name, TREE_VARIANT)
+#define TREE_SINGLE (TREE_VARIANT & 1)
+#define TREE_TARGET (TREE_VARIANT & 2)
+#define TREE_FORCE (TREE_VARIANT & 4)
+#define TREE_VERBOSE (TREE_VARIANT & 8)
+#define TREE_INLINE static inline __attribute__ ((always_inline))
+#endif
+
+/* If the numbered tile at ROW, COL has as many unknowns left around it as
+   mines missing, or no mines missing, force the unknowns on or off, on
+   account of unknown SOURCE. Returns the number forced. */
+TREE_INLINE int TREE_NAME (resolve) (int row, int col, int **grid,
+                                     int source)
+{
+  struct ind tiles[8];
+  int unknowns = 0;
+  int mines = 0;
+  int i, j;
+
+  int tile_num = grid[row][col];
+  if (tile_num < 0 || tile_num > 8)
+    return 0;
+
+  for (i = -1; i < 2; i++)
+    for (j = -1; j < 2; j++)
+      {
+        if (grid[row+i][col+j] == UNKNOWN)
+          {
+            tiles[unknowns].row = row + i;
+            tiles[unknowns++].col = col + j;
+          }
+        else if (is_mine (grid[row+i][col+j]))
+          mines++;
+      }
+
+  int val;
+  if (tile_num == mines + unknowns)
+    val = force_on (source);
+  else if (tile_num == mines)
+    val = force_off (source);
+  else
+    return 0;
+
+  // The search always keeps a trail.
+  int k;
+  for (k = 0; k < unknowns; k++)
+    {
+      int *tile = &grid[tiles[k].row][tiles[k].col];
+      if (TREE_VERBOSE && print >= PRINT_DEBUG)
+        fprintf (stderr, "[%d][%d] forced %s\n", tiles[k].row, tiles[k].col,
+                 is_mine (val) ? "on" : "off");
+      trail[trail_len++] = tile;
+      *tile = val;
+    }
+
+  thr_stats[thread_num].forced += unknowns;
+  TRACE (TRACE_FORCE, source, is_mine (val), unknowns);
+  return unknowns;
+}
+
+/* Check the numbered tiles around unknown UNKNOWN_NUM at IND, just
+   assigned, and with CHECK_FORCE, force what they leave no choice in. */
+TREE_INLINE bool TREE_NAME (check) (struct ind ind, int **grid,
+                                    int unknown_num, bool check_force)
+{
+  int row = ind.row;
+  int col = ind.col;
+  int i, j, k, l;
+
+  for (i = -1; i < 2; i++)
+    for (j = -1; j < 2; j++)
+      {
+        int tile_num = grid[row+i][col+j];
+        if (0 <= tile_num && tile_num <= 8)
+          {
+            int local_mines = 0;
+            int local_unknowns = 0;
+            for (k = -1; k < 2; k++)
+              for (l = -1; l < 2; l++)
+                {
+                  if (is_mine (grid[row+i+k][col+j+l]))
+                    local_mines++;
+                  else if (grid[row+i+k][col+j+l] == UNKNOWN)
+                    local_unknowns++;
+                }
+            if (tile_num < local_mines
+                || tile_num > local_mines + local_unknowns)
+              return false;
+          }
+      }
+
+  if (TREE_FORCE && check_force)
+    {
+      TREE_NAME (resolve) (row, col + 1, grid, unknown_num);
+      for (j = -1; j < 2; j++)
+        TREE_NAME (resolve) (row + 1, col + j, grid, unknown_num);
+    }
+
+  return true;
+}
+
+/* Claim a solution just found. */
+TREE_INLINE bool TREE_NAME (claim) ()
+{
+  if (TREE_SINGLE && atomic_exchange (&search_stop, true))
+    return false;
+  thr_stats[thread_num].goals++;
+  return true;
+}
+
+/* Count the solution just found on BUFS, and print it as asked. */
+TREE_INLINE int TREE_NAME (goal) (struct buffers bufs)
+{
+  if (!TREE_NAME (claim) ())
+    return 0;
+  if (TREE_VERBOSE)
+    {
+      if (diag)
+        diag_print (bufs.ind, bufs.grid);
+      if (print >= PRINT_ALL)
+        board_print (bufs.grid);
+    }
+  return 1;
+}
+
+/* solve_tree (), for this variant's options. */
+static int TREE_NAME (solve_tree) (int unknown_num, int mine_count,
+                                   bool sibling)
+{
+  struct buffers bufs = thr_data[thread_num].bufs;
+  struct frame *stack = thr_data[thread_num].stack;
+  int num_goals = 0;
+  int u = unknown_num;
+  int bottom = 0;             // Frames below it have no off state left.
+  enum { DOWN, TRY, BACK } step = DOWN;
+  stack_len = 0;
+  trail = thr_data[thread_num].trail;
+  trail_len = 0;
+
+  if (sibling)
+    {
+      // Search the on state as if the off state was just done here.
+      stack[0].unknown = u;
+      stack[0].mine_count = mine_count;
+      stack[0].mark = 0;
+      stack[0].goals = 0;
+      stack[0].weight = 2 * tree_weight;
+      stack[0].state = FRAME_OFF;
+      stack_len = 1;
+      step = BACK;
+    }
+
+  for (;;)
+    {
+      if (step == DOWN)
+        {
+          // Unwind once another thread has found the one solution wanted,
+          // or a budget has run out.
+          if (atomic_load_explicit (&search_stop, memory_order_relaxed))
+            break;
+
+          int row = bufs.ind[u].row;
+          int col = bufs.ind[u].col;
+          int *tile = &bufs.grid[row][col];
+          step = TRY;
+          if (mine_src (*tile) >= 0)
+            {
+              // Unknown was pre-assigned. Just move on to next unknown if
+              // consistent.
+              stats_node (u);
+              TRACE (TRACE_DECIDE, u, is_mine (*tile), 1);
+              step = BACK;
+              if (!TREE_NAME (check) (bufs.ind[u], bufs.grid, u, false))
+                {
+                  thr_stats[thread_num].consis_fails++;
+                  TRACE (TRACE_CONFLICT, u, 0, 0);
+                  tree_done ();
+                  continue;
+                }
+              if (is_mine (*tile))
+                mine_count++;
+              if (u < total_unknowns - 1)
+                {
+                  u++;
+                  step = DOWN;
+                }
+              else
+                {
+                  if (!TREE_TARGET || mine_count == mine_target)
+                    num_goals += TREE_NAME (goal) (bufs);
+                  tree_done ();
+                }
+            }
+          else if (TREE_TARGET && mine_count == mine_target)
+            {
+              // All mines are used up, just check the MINE_OFF subtree.
+              trail[trail_len++] = tile;
+              *tile = force_off (u);
+            }
+          else if (TREE_TARGET
+                   && (mine_target - mine_count) == (total_unknowns - u))
+            {
+              // To be a solution, all remaining mines must be on. Just check
+              // the MINE_ON subtree.
+              trail[trail_len++] = tile;
+              *tile = force_on (u);
+              mine_count++;
+            }
+          else if (!TREE_TARGET || mine_count < mine_target)
+            {
+              // Check both subtrees, off first. The frame holds what going
+              // back up to try on takes.
+              struct frame *f = &stack[stack_len++];
+              f->unknown = u;
+              f->mine_count = mine_count;
+              f->goals = num_goals;
+              f->weight = tree_weight;
+              f->state = FRAME_OFF;
+              tree_weight /= 2;
+              if (TREE_VERBOSE && print >= PRINT_DEBUG)
+                fprintf (stderr, "[%d][%d] off\n", row, col);
+              trail[trail_len++] = tile;
+              *tile = force_off (u);
+              f->mark = trail_len;
+            }
+          else
+            {
+              tree_done ();
+              step = BACK;
+            }
+        }
+      else if (step == TRY)
+        {
+          // Check the state just set.
+          stats_node (u);
+          TRACE (TRACE_DECIDE, u,
+                 is_mine (bufs.grid[bufs.ind[u].row][bufs.ind[u].col]), 0);
+          step = BACK;
+          if (!TREE_NAME (check) (bufs.ind[u], bufs.grid, u, true))
+            {
+              thr_stats[thread_num].consis_fails++;
+              TRACE (TRACE_CONFLICT, u, 0, 0);
+              tree_done ();
+            }
+          else if (u < total_unknowns - 1
+                   && (!TREE_TARGET || mine_count <= mine_target))
+            {
+              // A subtree exists:
+              // 1) Not all unknowns are assigned.
+              // 2) If MINE_TARGET is specified, it has not been exceeded.
+              // Give a thread idle the biggest part of the search left here.
+              if (stack_len > 0
+                  && thr_stats[thread_num].nodes >= split_recheck
+                  && atomic_load_explicit (&avail_threads,
+                                           memory_order_relaxed) > 0)
+                split_bottom (stack, &bottom);
+              u++;
+              step = DOWN;
+            }
+          else if (u == total_unknowns - 1
+                   && (!TREE_TARGET || mine_count == mine_target))
+            {
+              // Solution has been found:
+              // 1) All unknowns have been assigned a valid state.
+              // 2) MINE_TARGET, if specified, has been matched.
+              if (TREE_NAME (goal) (bufs))
+                {
+                  num_goals++;
+                  tree_done ();
+                }
+            }
+          else
+            {
+              // The remaining case is that all unknown tiles have been
+              // assigned, and MINE_TARGET was specified but not reached.
+              // Here, there is nothing to be done.
+              tree_done ();
+            }
+        }
+      else
+        {
+          // Go back up to the last unknown with its on state left.
+          while (stack_len > 0 && stack[stack_len-1].state != FRAME_OFF)
+            tree_weight = stack[--stack_len].weight;
+          if (bottom > stack_len)
+            bottom = stack_len;
+          if (stack_len == 0)
+            break;
+
+          // If only a single solution is desired, and it's been found, or
+          // the search was stopped meanwhile, then we're done.
+          struct frame *f = &stack[stack_len-1];
+          if ((TREE_SINGLE && num_goals > f->goals)
+              || atomic_load_explicit (&search_stop, memory_order_relaxed))
+            break;
+
+          u = f->unknown;
+          mine_count = f->mine_count + 1;
+          f->state = FRAME_ON;
+          trail_undo (f->mark);
+          if (TREE_VERBOSE && print >= PRINT_DEBUG)
+            fprintf (stderr, "[%d][%d] on\n", bufs.ind[u].row,
+                     bufs.ind[u].col);
+          bufs.grid[bufs.ind[u].row][bufs.ind[u].col] = force_on (u);
+          thr_stats[thread_num].backtracks++;
+          step = TRY;
+        }
+    }
+
+  trail = NULL;
+  return num_goals;
+}
+
+#undef TREE_VARIANT
@@ -0,0 +1,224 @@
+/* Minesweeper solution set diagrams. See ms_zdd.h for the file layout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ms_zdd.h"
+
+/* Iterator state: the path from the root, and the branch last taken at each
+   node of it. */
+struct ms_zdd_iter
+{
+  const struct ms_zdd *zdd;
+  int depth;                  // Length of the path.
+  int *path;                  // Nodes on the path.
+  signed char *branch;        // 0: LO not taken yet, 1: on LO, 2: on HI.
+  unsigned char *mines;       // Current solution, by unknown.
+  bool started;
+};
+
+/* Read a diagram written by ms_zdd_write (). Returns NULL if the file can't
+   be read, or isn't a well formed diagram. */
+struct ms_zdd * ms_zdd_read (const char *file)
+{
+  FILE *fh = fopen (file, "rb");
+  if (!fh)
+    return NULL;
+
+  char magic[8];
+  int head[5];
+  struct ms_zdd *zdd = (struct ms_zdd *) calloc (1, sizeof *zdd);
+  bool valid = fread (magic, 1, 8, fh) == 8
+    && !memcmp (magic, MS_ZDD_MAGIC, 8)
+    && fread (head, sizeof (int), 5, fh) == 5
+    && head[2] >= 0 && head[3] >= 2 && head[4] >= 0 && head[4] < head[3];
+  if (valid)
+    {
+      zdd->rows = head[0];
+      zdd->cols = head[1];
+      zdd->nvars = head[2];
+      zdd->nnodes = head[3];
+      zdd->root = head[4];
+      zdd->vars = (int (*)[2]) malloc ((zdd->nvars + 1) * sizeof *zdd->vars);
+      zdd->nodes = (struct ms_zdd_node *)
+        malloc (zdd->nnodes * sizeof *zdd->nodes);
+      valid = fread (zdd->vars, sizeof *zdd->vars, zdd->nvars, fh)
+        == (size_t) zdd->nvars
+        && fread (zdd->nodes + 2, sizeof *zdd->nodes, zdd->nnodes - 2, fh)
+        == (size_t) zdd->nnodes - 2;
+    }
+
+  // Terminals test past the last unknown.
+  int i;
+  if (valid)
+    for (i = 0; i < 2; i++)
+      {
+        zdd->nodes[i].var = zdd->nvars;
+        zdd->nodes[i].lo = zdd->nodes[i].hi = i;
+      }
+
+  // Children must come before their parent, and test later unknowns.
+  for (i = 2; valid && i < zdd->nnodes; i++)
+    {
+      struct ms_zdd_node *node = &zdd->nodes[i];
+      valid = node->var >= 0 && node->var < zdd->nvars
+        && node->lo >= 0 && node->lo < i && node->hi >= 0 && node->hi < i
+        && zdd->nodes[node->lo].var > node->var
+        && zdd->nodes[node->hi].var > node->var;
+    }
+
+  fclose (fh);
+  if (!valid)
+    {
+      ms_zdd_free (zdd);
+      return NULL;
+    }
+  return zdd;
+}
+
+/* Write ZDD to FILE. Returns 0 on success, -1 on failure. */
+int ms_zdd_write (const struct ms_zdd *zdd, const char *file)
+{
+  FILE *fh = fopen (file, "wb");
+  if (!fh)
+    return -1;
+
+  char magic[8] = MS_ZDD_MAGIC;
+  int head[5] = {zdd->rows, zdd->cols, zdd->nvars, zdd->nnodes, zdd->root};
+  bool ok = fwrite (magic, 1, 8, fh) == 8
+    && fwrite (head, sizeof (int), 5, fh) == 5
+    && fwrite (zdd->vars, sizeof *zdd->vars, zdd->nvars, fh)
+    == (size_t) zdd->nvars
+    && fwrite (zdd->nodes + 2, sizeof *zdd->nodes, zdd->nnodes - 2, fh)
+    == (size_t) zdd->nnodes - 2;
+  if (fclose (fh) || !ok)
+    return -1;
+  return 0;
+}
+
+void ms_zdd_free (struct ms_zdd *zdd)
+{
+  free (zdd->vars);
+  free (zdd->nodes);
+  free (zdd);
+}
+
+/* Number of solutions below each node. Children come first, so one pass in
+   order does it. */
+static long double * zdd_counts (const struct ms_zdd *zdd)
+{
+  long double *count = (long double *)
+    malloc (zdd->nnodes * sizeof (long double));
+  int i;
+  count[MS_ZDD_EMPTY] = 0;
+  count[MS_ZDD_UNIT] = 1;
+  for (i = 2; i < zdd->nnodes; i++)
+    count[i] = count[zdd->nodes[i].lo] + count[zdd->nodes[i].hi];
+  return count;
+}
+
+/* Number of solutions. */
+long double ms_zdd_count (const struct ms_zdd *zdd)
+{
+  long double *count = zdd_counts (zdd);
+  long double total = count[zdd->root];
+  free (count);
+  return total;
+}
+
+/* Fill PROB with the fraction of solutions in which each unknown is a mine.
+   An unknown is a mine on a path only by taking the HI child of a node that
+   tests it, so its count is the sum over those nodes of the paths from the
+   root to the node times the solutions below its HI child. */
+void ms_zdd_marginals (const struct ms_zdd *zdd, double *prob)
+{
+  long double *count = zdd_counts (zdd);
+  long double *paths = (long double *)
+    calloc (zdd->nnodes, sizeof (long double));
+  long double *on = (long double *)
+    calloc (zdd->nvars + 1, sizeof (long double));
+  int i;
+
+  paths[zdd->root] = 1;
+  for (i = zdd->root; i >= 2; i--)
+    {
+      struct ms_zdd_node *node = &zdd->nodes[i];
+      paths[node->lo] += paths[i];
+      paths[node->hi] += paths[i];
+      on[node->var] += paths[i] * count[node->hi];
+    }
+  for (i = 0; i < zdd->nvars; i++)
+    prob[i] = count[zdd->root] > 0 ? on[i] / count[zdd->root] : 0;
+
+  free (count);
+  free (paths);
+  free (on);
+}
+
+struct ms_zdd_iter * ms_zdd_iter_new (const struct ms_zdd *zdd)
+{
+  struct ms_zdd_iter *iter = (struct ms_zdd_iter *) malloc (sizeof *iter);
+  iter->zdd = zdd;
+  iter->depth = 0;
+  iter->path = (int *) malloc ((zdd->nvars + 2) * sizeof (int));
+  iter->branch = (signed char *) malloc (zdd->nvars + 2);
+  iter->mines = (unsigned char *) calloc (zdd->nvars + 1, 1);
+  iter->started = false;
+  return iter;
+}
+
+/* Move on to the next solution, depth first with clear before mine, and
+   copy it into MINES, one byte per unknown. Returns false once there are no
+   more. */
+bool ms_zdd_iter_next (struct ms_zdd_iter *iter, unsigned char *mines)
+{
+  const struct ms_zdd *zdd = iter->zdd;
+  if (!iter->started)
+    {
+      iter->started = true;
+      iter->path[0] = zdd->root;
+      iter->branch[0] = 0;
+      iter->depth = 1;
+    }
+  else if (iter->depth > 0)
+    iter->depth--;            // Back off the unit terminal of the last one.
+
+  while (iter->depth > 0)
+    {
+      int top = iter->depth - 1;
+      int n = iter->path[top];
+      if (n == MS_ZDD_EMPTY)
+        {
+          iter->depth--;
+          continue;
+        }
+      if (n == MS_ZDD_UNIT)
+        {
+          memcpy (mines, iter->mines, zdd->nvars);
+          return true;
+        }
+
+      struct ms_zdd_node *node = &zdd->nodes[n];
+      if (iter->branch[top] == 2)
+        {
+          iter->mines[node->var] = 0;
+          iter->depth--;
+          continue;
+        }
+      iter->branch[top]++;
+      if (iter->branch[top] == 2)
+        iter->mines[node->var] = 1;
+      iter->path[iter->depth] = iter->branch[top] == 1 ? node->lo : node->hi;
+      iter->branch[iter->depth++] = 0;
+    }
+  return false;
+}
+
+void ms_zdd_iter_free (struct ms_zdd_iter *iter)
+{
+  free (iter->path);
+  free (iter->branch);
+  free (iter->mines);
+  free (iter);
+}
@@ -0,0 +1,62 @@
+/* Minesweeper solution set diagrams.
+   A set of solutions is stored as a zero-suppressed decision diagram (ZDD)
+   over the unknowns of a board: each solution is the set of unknowns that
+   are mines, and each path from the root to the unit terminal is one
+   solution. A node tests one unknown, its LO child leading to the solutions
+   where it is clear and its HI child to those where it is a mine. Unknowns
+   skipped on a path are clear.
+
+   File layout, in native byte order with 32 bit ints:
+     magic         MS_ZDD_MAGIC, 8 bytes
+     rows cols     Board dimensions.
+     nvars         Number of unknowns.
+     nnodes        Number of nodes, terminals included.
+     root          Root node.
+     vars          Row and column of each unknown, from 0, in order.
+     nodes         VAR, LO and HI of each node past the terminals.
+   Node 0 is the empty terminal and node 1 the unit terminal. Every node's
+   children come before it, and test later unknowns.
+*/
+
+#ifndef MS_ZDD_H
+#define MS_ZDD_H
+
+#include <stdbool.h>
+
+#define MS_ZDD_MAGIC "MSZDD1\n"
+#define MS_ZDD_EMPTY 0
+#define MS_ZDD_UNIT 1
+
+struct ms_zdd_node
+{
+  int var;                    // Unknown tested.
+  int lo;                     // Child for the unknown clear.
+  int hi;                     // Child for the unknown a mine.
+};
+
+struct ms_zdd
+{
+  int rows;                   // Board dimensions.
+  int cols;
+  int nvars;                  // Number of unknowns.
+  int (*vars)[2];             // Row and column of each unknown.
+  int nnodes;                 // Number of nodes, terminals included.
+  struct ms_zdd_node *nodes;  // Nodes, terminals first.
+  int root;                   // Root node.
+};
+
+/* Iterator over the solutions in a diagram. */
+struct ms_zdd_iter;
+
+struct ms_zdd * ms_zdd_read (const char *file);
+int ms_zdd_write (const struct ms_zdd *zdd, const char *file);
+void ms_zdd_free (struct ms_zdd *zdd);
+
+long double ms_zdd_count (const struct ms_zdd *zdd);
+void ms_zdd_marginals (const struct ms_zdd *zdd, double *prob);
+
+struct ms_zdd_iter * ms_zdd_iter_new (const struct ms_zdd *zdd);
+bool ms_zdd_iter_next (struct ms_zdd_iter *iter, unsigned char *mines);
+void ms_zdd_iter_free (struct ms_zdd_iter *iter);
+
+#endif
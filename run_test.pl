@@ -43,7 +43,7 @@ if (@ARGV > 0 && $ARGV[0] =~ /all/) {
     print "\n\n";
 
     print "16 threads\n";
-    run_test_loop ("-t 8 -p 1");
+    run_test_loop ("-t 16 -p 1");
     print "\n\n";
 
     print "All Optimizations (8 threads)\n";
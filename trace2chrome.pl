@@ -0,0 +1,187 @@
+#! /usr/bin/perl
+# Convert a trace written by ms_solve built with "make trace" to the Chrome
+# trace event format, for chrome://tracing or Perfetto, or to folded stacks
+# for flamegraph.pl.
+
+use warnings;
+use strict;
+sub usage;
+sub read_trace;
+sub chrome;
+sub folded;
+
+# Record types, as in ms_solve.c.
+my ($DECIDE, $FORCE, $CONFLICT, $SPLIT, $STEAL, $DONE) = (0 .. 5);
+
+my $folded = 0;
+my $levels = 12;
+while (@ARGV && $ARGV[0] =~ /^-/)
+{
+    my $opt = shift @ARGV;
+    if ($opt eq "-f") { $folded = 1; }
+    elsif ($opt eq "-d") { $levels = shift @ARGV; }
+    else { usage (); }
+}
+my $file = @ARGV ? $ARGV[0] : "ms_solve.trace";
+
+my ($ticks, $threads) = read_trace ($file);
+if ($folded) { folded ($ticks, $threads); }
+else { chrome ($ticks, $threads); }
+exit 0;
+
+
+sub usage
+{
+    print STDERR
+"Usage:
+  trace2chrome.pl [-f] [-d LEVELS] [FILE]
+    FILE:      trace to convert, ms_solve.trace by default.
+    -f:        print folded stacks for flamegraph.pl instead of Chrome
+               trace events.
+    -d LEVELS: number of top decision levels to show subtrees for, 12 by
+               default.
+";
+    exit 1;
+}
+
+# Read the trace. Returns ticks per ms, and for each thread a reference to
+# its list of records, each [tsc, depth, type, val, arg].
+sub read_trace
+{
+    my ($file) = @_;
+    open (my $fh, "<:raw", $file) or die "Could not open $file.\n";
+    my $buf;
+    read ($fh, $buf, 24) == 24 or die "Truncated trace.\n";
+    my ($magic, $nthreads, $pad, $ticks) = unpack ("a8 L L d", $buf);
+    $magic eq "MSTRACE1" or die "Not a trace file.\n";
+
+    my @threads;
+    for (my $i = 0; $i < $nthreads; $i++)
+    {
+        read ($fh, $buf, 8) == 8 or die "Truncated trace.\n";
+        my $n = unpack ("Q", $buf);
+        read ($fh, $buf, 16 * $n) == 16 * $n or die "Truncated trace.\n";
+        my @recs;
+        for (my $j = 0; $j < $n; $j++)
+        {
+            push @recs, [unpack ("Q l C C S", substr ($buf, 16 * $j, 16))];
+        }
+        push @threads, \@recs;
+    }
+    close ($fh);
+    return ($ticks, \@threads);
+}
+
+# Print Chrome trace events. Each thread's time on a subtree is a span, and
+# so is every decision on the top LEVELS levels, nested by depth, so the
+# spans of hot subtrees stand out. Gaps between spans are idle time. Splits
+# are instant events, and conflicts a counter per ms.
+sub chrome
+{
+    my ($ticks, $threads) = @_;
+    my $t0;
+    foreach my $recs (@$threads)
+    {
+        $t0 = $$recs[0][0] if @$recs && (!defined $t0 || $$recs[0][0] < $t0);
+    }
+    my $us = sub { sprintf ("%.3f", ($_[0] - $t0) * 1000 / $ticks) };
+
+    my @events;
+    for (my $tid = 0; $tid < @$threads; $tid++)
+    {
+        my $recs = $$threads[$tid];
+        push @events, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+            . "\"tid\": $tid, \"args\": {\"name\": \"thread $tid\"}}";
+
+        # Open spans, as [start, depth, name], deepest last.
+        my @open;
+        my %conflicts;
+        my $close = sub {
+            my ($tsc, $depth) = @_;
+            while (@open && $open[-1][1] >= $depth)
+            {
+                my $span = pop @open;
+                my $dur = sprintf ("%.3f", ($tsc - $$span[0]) * 1000 / $ticks);
+                push @events, "{\"name\": \"$$span[2]\", \"ph\": \"X\", "
+                    . "\"pid\": 0, \"tid\": $tid, \"ts\": " . $us->($$span[0])
+                    . ", \"dur\": $dur}";
+            }
+        };
+
+        foreach my $rec (@$recs)
+        {
+            my ($tsc, $depth, $type, $val, $arg) = @$rec;
+            if ($type == $STEAL)
+            {
+                $close->($tsc, -1);
+                push @open, [$tsc, -1, "subtree from unknown $depth"];
+            }
+            elsif ($type == $DONE)
+            {
+                $close->($tsc, -1);
+            }
+            elsif ($type == $DECIDE)
+            {
+                $close->($tsc, $depth);
+                push @open, [$tsc, $depth, "unknown $depth = $val"]
+                    if $depth < $levels;
+            }
+            elsif ($type == $SPLIT)
+            {
+                push @events, "{\"name\": \"split to thread $arg\", "
+                    . "\"ph\": \"i\", \"s\": \"t\", \"pid\": 0, "
+                    . "\"tid\": $tid, \"ts\": " . $us->($tsc) . "}";
+            }
+            elsif ($type == $CONFLICT)
+            {
+                $conflicts{int (($tsc - $t0) / $ticks)}++;
+            }
+        }
+        $close->($$recs[-1][0], -1) if @$recs;
+
+        foreach my $ms (sort { $a <=> $b } keys %conflicts)
+        {
+            push @events, "{\"name\": \"conflicts $tid\", \"ph\": \"C\", "
+                . "\"pid\": 0, \"tid\": $tid, \"ts\": " . ($ms * 1000)
+                . ", \"args\": {\"per ms\": $conflicts{$ms}}}";
+        }
+    }
+
+    print "{\"traceEvents\": [\n" . join (",\n", @events) . "\n]}\n";
+}
+
+# Print folded stacks: the path of decisions on the top LEVELS levels, under
+# the thread, weighed by the time in us until the thread's next record.
+sub folded
+{
+    my ($ticks, $threads) = @_;
+    my %weight;
+    for (my $tid = 0; $tid < @$threads; $tid++)
+    {
+        my $recs = $$threads[$tid];
+        my @path;
+        for (my $j = 0; $j + 1 < @$recs; $j++)
+        {
+            my ($tsc, $depth, $type, $val) = @{$$recs[$j]};
+            if ($type == $DECIDE && $depth < $levels)
+            {
+                # Decisions on the same or deeper levels are undone.
+                pop @path while @path && $path[-1][0] >= $depth;
+                push @path, [$depth, $val];
+            }
+            elsif ($type == $STEAL)
+            {
+                @path = ();
+            }
+            my $stack = join (";", "thread $tid",
+                              map { "u$$_[0]=$$_[1]" } @path);
+            $weight{$stack} += ($$recs[$j+1][0] - $tsc) * 1000 / $ticks;
+        }
+    }
+
+    foreach my $stack (sort keys %weight)
+    {
+        next if $weight{$stack} < 0.5;
+        printf "%s %d\n", $stack, $weight{$stack} + 0.5;
+    }
+}